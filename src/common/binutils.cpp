@@ -1,63 +1,53 @@
-#include <vector>
-#include <cstdint>
+#include <stdexcept>
+#include <format>
 #include "binutils.h"
 
 using namespace M2PBinUtils;
 
 
-char M2PBinUtils::readChar(std::ifstream& file)
+void BinaryCursor::require(size_t length) const
 {
-	char buffer{};
-	file.read(&buffer, sizeof(char));
-	return buffer;
+	if (length > remaining())
+		throw std::runtime_error(std::format(
+			"Unexpected end of file reading {} bytes at offset {}", length, m_offset));
 }
 
-void M2PBinUtils::readChar(std::ifstream& file, char* buffer)
+void BinaryCursor::seek(size_t offset)
 {
-	file.read(buffer, sizeof(char));
+	if (offset > m_data.size())
+		throw std::runtime_error(std::format("Offset {} is past the end of the file", offset));
+	m_offset = offset;
 }
 
-unsigned char M2PBinUtils::readByte(std::ifstream& file)
+void BinaryCursor::skip(size_t length)
 {
-	unsigned char buffer{};
-	file.read(reinterpret_cast<char*>(&buffer), sizeof(unsigned char));
-	return buffer;
+	require(length);
+	m_offset += length;
 }
 
-std::int32_t M2PBinUtils::readInt(std::ifstream& file)
+std::string_view BinaryCursor::readBytes(size_t length)
 {
-    std::int32_t buffer{};
-    file.read(reinterpret_cast<char*>(&buffer), sizeof(std::int32_t));
-    return buffer;
+	require(length);
+	std::string_view bytes = m_data.substr(m_offset, length);
+	m_offset += length;
+	return bytes;
 }
 
-float M2PBinUtils::readFloat(std::ifstream& file)
+std::string_view BinaryCursor::readNTString(size_t length)
 {
-	float buffer{};
-	file.read(reinterpret_cast<char*>(&buffer), sizeof(float));
-	return buffer;
+	std::string_view bytes = readBytes(length);
+	return bytes.substr(0, bytes.find('\0'));
 }
 
-std::string M2PBinUtils::readNTString(std::ifstream& file, size_t length)
+std::string_view BinaryCursor::readLPString()
 {
-	if (length < 1)
-		return "";
-	std::vector<char> bytes;
-	bytes.assign(length, '\0');
-	file.read(reinterpret_cast<char*>(bytes.data()), length);
-	if (bytes.back() != '\0')
-		bytes.emplace_back('\0');
-	return std::string{ bytes.data() };
+	return readNTString(readByte());
 }
 
-std::string M2PBinUtils::readLPString(std::ifstream& file)
+std::string_view BinaryCursor::readIntLPString()
 {
-	unsigned char length = readByte(file);
-	return readNTString(file, length);
-}
-
-std::string M2PBinUtils::readIntLPString(std::ifstream& file)
-{
-	std::int32_t length = readInt(file);
-	return readNTString(file, length);
+	std::int32_t length = readInt();
+	if (length < 0)
+		throw std::runtime_error(std::format("Invalid string length {} at offset {}", length, m_offset));
+	return readNTString(static_cast<size_t>(length));
 }
@@ -1,16 +1,62 @@
 #pragma once
 
 #include <string>
-#include <fstream>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
 
 namespace M2PBinUtils
 {
-	char readChar(std::ifstream& file);
-	void readChar(std::ifstream& file, char *buffer);
-	unsigned char readByte(std::ifstream& file);
-	std::int32_t readInt(std::ifstream& file);
-	float readFloat(std::ifstream& file);
-	std::string readNTString(std::ifstream& file, size_t length);
-	std::string readLPString(std::ifstream& file);
-	std::string readIntLPString(std::ifstream& file);
-}
\ No newline at end of file
+	/**
+	 * Reads little-endian binary data out of a block of memory, such as a MappedFile view.
+	 * Every read is bounds checked and throws std::runtime_error past the end of the data.
+	 * Strings are returned as views into the data, so they are only valid as long as it is.
+	 */
+	class BinaryCursor
+	{
+	public:
+		BinaryCursor() = default;
+		BinaryCursor(std::string_view data, size_t offset = 0) : m_data(data) { seek(offset); }
+
+		/** All of the data, for starting other cursors at known offsets */
+		std::string_view data() const { return m_data; }
+		size_t offset() const { return m_offset; }
+		size_t remaining() const { return m_data.size() - m_offset; }
+		bool atEnd() const { return m_offset >= m_data.size(); }
+
+		void seek(size_t offset);
+		void skip(size_t length);
+
+		template <typename T>
+		void read(T& out)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only plain data can be read directly");
+			std::memcpy(&out, readBytes(sizeof(T)).data(), sizeof(T));
+		}
+		template <typename T>
+		T read()
+		{
+			T value{};
+			read(value);
+			return value;
+		}
+
+		unsigned char readByte() { return read<unsigned char>(); }
+		std::int32_t readInt() { return read<std::int32_t>(); }
+		float readFloat() { return read<float>(); }
+
+		std::string_view readBytes(size_t length);
+		/** Fixed length string, cut at the first null character */
+		std::string_view readNTString(size_t length);
+		/** String prefixed by its length as a byte */
+		std::string_view readLPString();
+		/** String prefixed by its length as a 32-bit integer */
+		std::string_view readIntLPString();
+	private:
+		std::string_view m_data;
+		size_t m_offset = 0;
+
+		void require(size_t length) const;
+	};
+}
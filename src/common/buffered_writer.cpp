@@ -0,0 +1,49 @@
+#include "buffered_writer.h"
+
+using namespace M2PUtils;
+
+
+BufferedWriter::BufferedWriter(const std::filesystem::path& filepath, size_t bufferSize)
+	: m_file(filepath), m_bufferSize(bufferSize)
+{
+	m_buffer.reserve(bufferSize);
+}
+
+BufferedWriter::~BufferedWriter()
+{
+	flush();
+}
+
+void BufferedWriter::write(std::string_view text)
+{
+	if (m_file.is_open() && m_buffer.size() + text.size() > m_bufferSize)
+	{
+		flush();
+
+		// Too big to be worth copying into the buffer
+		if (text.size() >= m_bufferSize)
+		{
+			m_file.write(text.data(), static_cast<std::streamsize>(text.size()));
+			return;
+		}
+	}
+	m_buffer += text;
+}
+
+void BufferedWriter::write(char c)
+{
+	if (m_file.is_open() && m_buffer.size() >= m_bufferSize)
+		flush();
+	m_buffer += c;
+}
+
+bool BufferedWriter::flush()
+{
+	if (!m_file.is_open())
+		return true;
+
+	m_file.write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+	m_buffer.clear();
+	m_file.flush();
+	return m_file.good();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <filesystem>
+#include <charconv>
+#include <concepts>
+
+namespace M2PUtils
+{
+	/**
+	 * Collects text in a large buffer and writes it to the file in big blocks.
+	 * Without a file it only collects the text, for str().
+	 * The file is opened in text mode, like a plain std::ofstream.
+	 */
+	class BufferedWriter
+	{
+	public:
+		static inline constexpr size_t c_DEFAULT_BUFFER_SIZE = 1 << 20;
+
+		BufferedWriter() = default;
+		BufferedWriter(const std::filesystem::path& filepath, size_t bufferSize = c_DEFAULT_BUFFER_SIZE);
+		BufferedWriter(const BufferedWriter& other) = delete;
+		BufferedWriter& operator=(const BufferedWriter& other) = delete;
+		~BufferedWriter();
+
+		bool isOpen() const { return m_file.is_open(); }
+		/** Text collected so far, only all of it when there is no file */
+		const std::string& str() const { return m_buffer; }
+
+		void write(std::string_view text);
+		void write(char c);
+		/** Same text as std::format("{:.6g}", value) */
+		template <std::floating_point T>
+		void write(T value)
+		{
+			char digits[32];
+			const auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::general, 6);
+			write(std::string_view{ digits, static_cast<size_t>(end - digits) });
+		}
+
+		/**
+		 * Writes the buffer out to the file
+		 * @return Whether everything written so far made it to the file
+		 */
+		bool flush();
+	private:
+		std::ofstream m_file;
+		std::string m_buffer;
+		size_t m_bufferSize = 0;
+	};
+}
@@ -0,0 +1,116 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+using namespace M2PUtils;
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::filesystem::path& filepath)
+{
+	HANDLE file = CreateFileW(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+	m_fileHandle = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		unmap();
+		return;
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+	m_open = true;
+
+	// Empty files can't be mapped, they just have an empty view
+	if (m_size == 0)
+		return;
+
+	m_mappingHandle = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mappingHandle)
+		m_data = static_cast<const char*>(MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+
+	if (!m_data)
+	{
+		unmap();
+		m_open = false;
+	}
+}
+
+void MappedFile::unmap()
+{
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mappingHandle)
+		CloseHandle(m_mappingHandle);
+	if (m_fileHandle)
+		CloseHandle(m_fileHandle);
+	m_data = nullptr;
+	m_mappingHandle = nullptr;
+	m_fileHandle = nullptr;
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path& filepath)
+{
+	int file = ::open(filepath.c_str(), O_RDONLY);
+	if (file < 0)
+		return;
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || !S_ISREG(info.st_mode))
+	{
+		::close(file);
+		return;
+	}
+	m_size = static_cast<size_t>(info.st_size);
+	m_open = true;
+
+	// Empty files can't be mapped, they just have an empty view
+	if (m_size > 0)
+	{
+		void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (data == MAP_FAILED)
+		{
+			m_size = 0;
+			m_open = false;
+		}
+		else
+		{
+			madvise(data, m_size, MADV_SEQUENTIAL);
+			m_data = static_cast<const char*>(data);
+		}
+	}
+
+	// The mapping keeps its own reference to the file
+	::close(file);
+}
+
+void MappedFile::unmap()
+{
+	if (m_data)
+		munmap(const_cast<char*>(m_data), m_size);
+	m_data = nullptr;
+}
+#endif
+
+MappedFile::~MappedFile()
+{
+	unmap();
+}
+
+void MappedFile::detach()
+{
+	if (m_data)
+		m_owned.assign(m_data, m_size);
+	unmap();
+}
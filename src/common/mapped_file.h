@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <filesystem>
+
+namespace M2PUtils
+{
+	/**
+	 * Read only memory mapping of a whole file.
+	 * Text parsed out of it should be kept as offsets, so it stays valid after detach().
+	 */
+	class MappedFile
+	{
+	public:
+		MappedFile(const std::filesystem::path& filepath);
+		MappedFile(const MappedFile& other) = delete;
+		MappedFile& operator=(const MappedFile& other) = delete;
+		~MappedFile();
+
+		bool isOpen() const { return m_open; }
+		std::string_view view() const { return m_owned.empty() ? std::string_view{ m_data, m_size } : m_owned; }
+		std::string_view view(size_t offset, size_t length) const { return view().substr(offset, length); }
+
+		/**
+		 * Copies the contents into memory and closes the mapping,
+		 * so the file on disk may be overwritten.
+		 */
+		void detach();
+	private:
+		bool m_open = false;
+		const char* m_data = nullptr;
+		size_t m_size = 0;
+		std::string m_owned;
+#ifdef _WIN32
+		void* m_fileHandle = nullptr;
+		void* m_mappingHandle = nullptr;
+#endif
+
+		void unmap();
+	};
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace M2PUtils
+{
+	/**
+	 * Calls task(index) for every index below count, with the workers taking
+	 * blocks of blockSize indices until none are left. The calling thread works too.
+	 * The first exception thrown by a task is rethrown once all workers have stopped.
+	 * @param threads Number of threads to use, 0 uses all hardware threads
+	 */
+	template <typename Task>
+	void parallelFor(size_t count, size_t blockSize, unsigned int threads, Task&& task)
+	{
+		const size_t numBlocks = (count + blockSize - 1) / blockSize;
+
+		if (threads == 0)
+			threads = std::max(std::thread::hardware_concurrency(), 1u);
+		threads = static_cast<unsigned int>(std::min<size_t>(threads, numBlocks));
+
+		if (threads <= 1)
+		{
+			for (size_t index = 0; index < count; ++index)
+				task(index);
+			return;
+		}
+
+		std::atomic<size_t> nextBlock{ 0 };
+		std::exception_ptr error;
+		std::mutex errorMutex;
+		auto worker = [&]()
+		{
+			try
+			{
+				for (size_t block = nextBlock++; block < numBlocks; block = nextBlock++)
+				{
+					const size_t end = std::min(count, (block + 1) * blockSize);
+					for (size_t index = block * blockSize; index < end; ++index)
+						task(index);
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard lock{ errorMutex };
+				if (!error)
+					error = std::current_exception();
+				nextBlock = numBlocks;  // Leave the remaining blocks
+			}
+		};
+
+		{
+			std::vector<std::jthread> workers;
+			workers.reserve(threads - 1);
+			for (unsigned int i = 1; i < threads; ++i)
+				workers.emplace_back(worker);
+			worker();
+		}
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+}
@@ -37,9 +37,11 @@ static inline const char* USAGE =
       -n | --wadcache       max number of .wad files to keep in memory
       -s | --smoothing      angle threshold for applying smoothing (use 0 to smooth all edges)
       -t | --time           timeout for running studiomdl.exe (default 60.0 seconds)
+      -j | --threads        number of threads used for reading, texture extraction and smoothing (use 0 for all cores, default 1)
       --verbose             enable verbose logging
       --renamechrome        rename chrome textures (disables chrome)
       --eager               use eager triangulation algorithm (faster)
+      --stream              convert .map input one entity at a time to keep memory use down
 
     QC options:
       --outputname          filename for the finished model
@@ -110,6 +112,16 @@ static inline void loadFromFileConfig(const M2PConfig::ConfigFile& configFile)
 
     if (!(value = configFile.getConfig("wad cache")).empty())
         g_config.wadCache = std::stoi(value);
+
+    if (!(value = configFile.getConfig("threads")).empty())
+    {
+        g_config.threads = std::stoi(value);
+        if (g_config.threads < 0)
+        {
+            logger.error("threads in the config file cannot be negative");
+            exit(EXIT_FAILURE);
+        }
+    }
 }
 
 
@@ -297,6 +309,18 @@ void M2PConfig::handleArgs(int argc, char** argv)
                 g_config.timeout = std::stof(argv[i]);
             continue;
         }
+        if (strcmp(argv[i], "--threads") == 0 || strcmp(argv[i], "-j") == 0)
+        {
+            ++i;
+            if (i < argc)
+                g_config.threads = std::stoi(argv[i]);
+            if (g_config.threads < 0)
+            {
+                logger.error("--threads cannot be negative");
+                exit(EXIT_FAILURE);
+            }
+            continue;
+        }
         if (strcmp(argv[i], "--renamechrome") == 0)
         {
             g_config.renameChrome = true;
@@ -307,6 +331,11 @@ void M2PConfig::handleArgs(int argc, char** argv)
             g_config.eager = true;
             continue;
         }
+        if (strcmp(argv[i], "--stream") == 0)
+        {
+            g_config.stream = true;
+            continue;
+        }
         if (strcmp(argv[i], "--verbose") == 0)
         {
             Logging::Logger::setGlobalConsoleLevelDebug();
@@ -371,6 +400,12 @@ void M2PConfig::handleArgs(int argc, char** argv)
         exit(EXIT_FAILURE);
     }
 
+    if (g_config.stream && !g_config.isMap())
+    {
+        logger.error("Cannot use --stream with \"" + extension + "\" files");
+        exit(EXIT_FAILURE);
+    }
+
     g_config.inputDir = g_config.inputFilepath.parent_path();
 
     logger.info(g_config.input);
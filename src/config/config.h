@@ -29,7 +29,9 @@ namespace M2PConfig
         bool mapcompile = false;
         bool renameChrome = false;
         bool eager = false;
+        bool stream = false;
         int wadCache = 10;
+        int threads = 1;
         float smoothing = 60.f;
         float timeout = 60.f;
         float clipThreshold = 4.f;
@@ -169,6 +169,7 @@ studiomdl = %(steam directory)s/steamapps/common/Sven Co-op SDK/modelling/studio
 autocompile = yes
 timeout = 60.0
 wad cache = 10
+threads = 1
 wad list = 
 ;Example wad list:
 ;wad list = %(steam directory)s/steamapps/common/Half-Life/valve/halflife.wad,
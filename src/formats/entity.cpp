@@ -1,7 +1,9 @@
 #include <format>
+#include <unordered_set>
 #include "entity.h"
 #include "utils.h"
 #include "wad3handler.h"
+#include "config.h"
 
 using namespace M2PEntity;
 
@@ -82,43 +84,39 @@ M2PGeo::Vector3 Brush::getCenter() const
 }
 
 
-Entity::Entity()
+std::string Entity::toString() const
 {
-	raw.reserve(1024);
+	M2PUtils::BufferedWriter writer;
+	write(writer);
+	return writer.str();
 }
 
-std::string Entity::toString() const
+static inline void writeKeyvalues(M2PUtils::BufferedWriter& writer, const std::vector<std::pair<std::string, std::string>>& keyvalues)
 {
-	std::string str;
-	str.reserve(raw.size());
-	str = "{\n";
-
-	for (std::pair<std::string, std::string> const& pair : keyvalues)
+	for (const std::pair<std::string, std::string>& kv : keyvalues)
 	{
-		str += std::format("\"{}\" \"{}\"\n", pair.first, pair.second);
+		writer.write('"');
+		writer.write(kv.first);
+		writer.write("\" \"");
+		writer.write(kv.second);
+		writer.write("\"\n");
 	}
+}
 
-	if (!brushes.empty())
-	{
-		for (auto &brush : brushes)
-		{
-			str += "{\n";
-			str += brush->getRaw();
-			str += "}\n";
-		}
-	}
-
-	str += "}\n";
-
-	return str;
+void Entity::write(M2PUtils::BufferedWriter& writer) const
+{
+	writer.write("{\n");
+	writeKeyvalues(writer, keyvalues);
+	for (const auto& brush : brushes)
+		brush->writeRaw(writer);
+	writer.write("}\n");
 }
 
-void Entity::writeToMap(std::ofstream& file) const
+void Entity::writeToMap(M2PUtils::BufferedWriter& writer) const
 {
-	file << "{\n";
-	for (const std::pair<std::string, std::string>& kv : keyvalues)
-		file << "\"" << kv.first << "\" \"" << kv.second << "\"\n";
-	file << "}\n";
+	writer.write("{\n");
+	writeKeyvalues(writer, keyvalues);
+	writer.write("}\n");
 }
 
 bool Entity::hasKey(const std::string& key) const
@@ -199,6 +197,9 @@ M2PGeo::Vector3 Entity::getOrigin() const
 
 M2PGeo::Bounds Entity::getBounds() const
 {
+	if (m_releasedBounds)
+		return *m_releasedBounds;
+
 	if (brushes.empty())
 		return M2PGeo::Bounds::zero();
 
@@ -232,6 +233,15 @@ M2PGeo::Bounds Entity::getBounds() const
 	return bounds;
 }
 
+void Entity::releaseFaces()
+{
+	if (!m_releasedBounds)
+		m_releasedBounds = getBounds();
+
+	for (auto& brush : brushes)
+		std::vector<Face>().swap(brush->faces);
+}
+
 M2PGeo::Bounds Entity::getCustomBounds() const
 {
 	std::string cMin = getKey("customclip_min"), cMax = getKey("customclip_max");
@@ -270,3 +280,115 @@ M2PGeo::Bounds Entity::getCustomBounds() const
 
 	return { boundsCenter - cBoundsSize, boundsCenter + cBoundsSize };
 }
+
+
+void Brush::writeRaw(M2PUtils::BufferedWriter& writer) const
+{
+	writer.write("{\n");
+	writer.write(getRaw());
+	writer.write("}\n");
+}
+
+static inline void writePoint(M2PUtils::BufferedWriter& writer, const M2PGeo::Vector3& point)
+{
+	writer.write("( ");
+	writer.write(point.x);
+	writer.write(' ');
+	writer.write(point.y);
+	writer.write(' ');
+	writer.write(point.z);
+	writer.write(" ) ");
+}
+
+static inline void writeAxis(M2PUtils::BufferedWriter& writer, const M2PGeo::Vector3& axis, FP shift)
+{
+	writer.write("[ ");
+	writer.write(axis.x);
+	writer.write(' ');
+	writer.write(axis.y);
+	writer.write(' ');
+	writer.write(axis.z);
+	writer.write(' ');
+	writer.write(shift);
+	writer.write(" ] ");
+}
+
+void M2PEntity::writeRawFace(M2PUtils::BufferedWriter& writer, const M2PGeo::Vector3& x, const M2PGeo::Vector3& y,
+	const M2PGeo::Vector3& z, const M2PGeo::Texture& texture)
+{
+	writePoint(writer, x);
+	writePoint(writer, y);
+	writePoint(writer, z);
+	writer.write(texture.name);
+	writer.write(' ');
+
+	writeAxis(writer, texture.rightaxis, texture.shiftx);
+	writeAxis(writer, texture.downaxis, texture.shifty);
+	writer.write(texture.angle);
+	writer.write(' ');
+	writer.write(texture.scalex);
+	writer.write(' ');
+	writer.write(texture.scaley);
+	writer.write('\n');
+}
+
+
+bool BaseReader::needsGeometry(const Entity& entity)
+{
+	// --mapcompile only converts enabled func_map2prop entities, everything else is written back from its raw faces
+	if (!M2PConfig::g_config.mapcompile)
+		return true;
+
+	return entity.classname == "func_map2prop"
+		&& !(entity.getKeyInt("spawnflags") & Spawnflags::DISABLE);
+}
+
+void BaseReader::resolveTextures(bool mapUVs, size_t firstEntity)
+{
+	std::vector<std::string> textureNames, allNames;
+	std::unordered_set<std::string> seen, allSeen;
+	bool hasRawFaces = false;
+	for (size_t i = firstEntity; i < entities.size(); ++i)
+	{
+		for (const auto& brush : entities[i]->brushes)
+		{
+			for (const Face& face : brush->faces)
+			{
+				if (seen.insert(face.texture.name).second)
+					textureNames.push_back(face.texture.name);
+				if (allSeen.insert(face.texture.name).second)
+					allNames.push_back(face.texture.name);
+			}
+			for (const RawFace& face : brush->rawFaces)
+			{
+				hasRawFaces = true;
+				if (allSeen.insert(face.texture.name).second)
+					allNames.push_back(face.texture.name);
+			}
+		}
+	}
+
+	// Raw faces are never extracted, but the WADs they use still go in the rewritten map
+	if (hasRawFaces)
+		wadHandler.findWads(allNames);
+	wadHandler.resolveTextures(textureNames);
+
+	for (size_t i = firstEntity; i < entities.size(); ++i)
+	{
+		for (auto& brush : entities[i]->brushes)
+		{
+			for (Face& face : brush->faces)
+			{
+				M2PWad3::ImageSize imageInfo = wadHandler.checkTexture(face.texture.name);
+				face.texture.width = imageInfo.width;
+				face.texture.height = imageInfo.height;
+
+				if (!mapUVs)
+					continue;
+
+				for (M2PGeo::Vertex& vertex : face.vertices)
+					vertex.uv = face.texture.uvForPoint(vertex);
+			}
+		}
+	}
+}
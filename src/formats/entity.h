@@ -2,7 +2,11 @@
 #include <array>
 #include <vector>
 #include <string>
+#include <memory>
+#include <optional>
 #include "geometry.h"
+#include "mapped_file.h"
+#include "buffered_writer.h"
 #include "wad3handler.h"
 
 namespace M2PEntity
@@ -21,25 +25,51 @@ namespace M2PEntity
         ORIGIN,
     };
 
+    /** func_map2prop spawnflags */
+    enum Spawnflags
+    {
+        DISABLE = 1,
+        IS_SUBMODEL = 2,
+        RENAME_CHROME = 4,
+    };
+
     struct Face
     {
         M2PGeo::Vector3 normal{};
         M2PGeo::Texture texture;
         std::vector<M2PGeo::Vertex> vertices;
+        /** Position index of each vertex in the source file, for formats that share them between faces */
+        std::vector<unsigned int> coordIndices;
     };
 
+    /** Just what a face needs to be written back out as MAP text, for brushes that aren't converted */
+    struct RawFace
+    {
+        std::array<M2PGeo::Vector3, 3> points;
+        M2PGeo::Texture texture;
+    };
+
+    /** Writes a face as a Valve 220 MAP plane line through the three points */
+    void writeRawFace(M2PUtils::BufferedWriter& writer, const M2PGeo::Vector3& x, const M2PGeo::Vector3& y,
+        const M2PGeo::Vector3& z, const M2PGeo::Texture& texture);
+
     class Brush
     {
     public:
         std::vector<Face> faces;
+        /** Faces of a brush read without its geometry, which only gets written back out */
+        std::vector<RawFace> rawFaces;
         std::string raw;
 
+        virtual ~Brush() = default;
         bool isToolBrush(ToolTexture toolTexture) const;
         bool isToolBrushAny() const;
         bool hasContentWater() const;
         M2PGeo::Bounds getBounds() const;
         M2PGeo::Vector3 getCenter() const;
         virtual std::string getRaw() const { return raw; }
+        /** Writes the brush back out as MAP text, braces included */
+        virtual void writeRaw(M2PUtils::BufferedWriter& writer) const;
     };
 
     class Entity
@@ -48,9 +78,7 @@ namespace M2PEntity
         std::string classname;
         std::vector<std::pair<std::string, std::string>> keyvalues;
         std::vector<std::unique_ptr<Brush>> brushes;
-        std::string raw;
 
-        Entity();
         bool hasKey(const std::string& key) const;
         std::string getKey(const std::string& key) const;
         void setKey(const std::string& key, const std::string& value);
@@ -62,9 +90,17 @@ namespace M2PEntity
         M2PGeo::Vector3 getOrigin() const;
         M2PGeo::Bounds getBounds() const;
         M2PGeo::Bounds getCustomBounds() const;
-        virtual std::string toString() const;
+        std::string toString() const;
 
-        void writeToMap(std::ofstream& file) const;
+        /** Writes the entity and its brushes back out as MAP text */
+        void write(M2PUtils::BufferedWriter& writer) const;
+        /** Writes only the keyvalues, for entities replacing brush entities */
+        void writeToMap(M2PUtils::BufferedWriter& writer) const;
+
+        /** Frees the brush faces once meshed, getBounds keeps returning the bounds they had */
+        void releaseFaces();
+    private:
+        std::optional<M2PGeo::Bounds> m_releasedBounds;
     };
 
 
@@ -73,7 +109,19 @@ namespace M2PEntity
     public:
         std::vector<std::unique_ptr<Entity>> entities;
         M2PWad3::Wad3Handler wadHandler;
+        /** Mapped input file the brushes keep their raw text in, if any */
+        std::shared_ptr<M2PUtils::MappedFile> source;
 
         bool hasMissingTextures() const { return wadHandler.hasMissingTextures(); };
+
+        /**
+         * Resolves the textures of the faces read so far in one batch and fills in their sizes
+         * @param mapUVs Also sets the vertex UVs from the texture axes, for formats without stored UVs
+         * @param firstEntity Index of the first entity to resolve
+         */
+        void resolveTextures(bool mapUVs, size_t firstEntity = 0);
+    protected:
+        /** Whether the entity gets converted, otherwise its brushes are only written back out */
+        static bool needsGeometry(const Entity& entity);
     };
 }
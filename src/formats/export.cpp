@@ -1,14 +1,18 @@
 #include <cmath>
+#include <cctype>
+#include <algorithm>
 #include <fstream>
 #include <filesystem>
 #include <format>
 #include <unordered_map>
+#include <unordered_set>
 #include "export.h"
 #include "config.h"
 #include "logging.h"
 #include "utils.h"
 #include "ear_clip.h"
 #include "halfedge.h"
+#include "smoothing.h"
 
 
 static inline Logging::Logger& logger = Logging::Logger::getLogger("export");
@@ -59,11 +63,9 @@ static inline void renameChrome(ModelData& model)
 
 static inline void applySmooth(ModelData& model)
 {
-	model.mesh.markSmoothEdges(model.smoothing, model.alwaysSmooth, model.neverSmooth);
-
-	for (const auto& pVertex : model.mesh.coords)
-		if (pVertex)
-			model.mesh.getSmoothFansByVertex(*pVertex);
+	M2PHalfEdge::SmoothEdgeCounts counts = model.flatMesh.markSmoothEdges(model.smoothing, model.alwaysSmoothIndex, model.neverSmoothIndex);
+	logger.debug(std::format("{}: {} sharp and {} smooth half-edges", model.outname, counts.sharp, counts.soft));
+	M2PHalfEdge::SmoothingGroups{ model.flatMesh }.smoothAll(static_cast<unsigned int>(g_config.threads));
 }
 
 
@@ -86,32 +88,31 @@ static inline int compileModel(const ModelData& model)
 }
 
 
-static inline void writeSmdFace(std::ofstream& file, std::array<M2PHalfEdge::Vertex, 3> vertices, bool flipped)
+static inline void writeSmdFace(std::ofstream& file, const M2PHalfEdge::FlatMesh& mesh, std::uint32_t face, bool flipped)
 {
+	std::array<const M2PHalfEdge::PackedVertex*, 3> vertices{
+		&mesh.faceVertices[face * 3], &mesh.faceVertices[face * 3 + 1], &mesh.faceVertices[face * 3 + 2]
+	};
 	if (flipped)
-	{
 		std::swap(vertices[0], vertices[1]);
-		for (M2PHalfEdge::Vertex &vertex : vertices)
-			vertex.normal = -vertex.normal;
-	}
 
-	for (const M2PHalfEdge::Vertex &vertex : vertices)
+	for (const M2PHalfEdge::PackedVertex* vertex : vertices)
 	{
 		file << "0\t";
-		const M2PGeo::Vector3& pos = vertex.position->coord();
-		const M2PGeo::Vector3& normal = vertex.normal;
+		const M2PGeo::Vector3 pos = mesh.position(vertex->position);
+		const M2PGeo::Vector3 normal = flipped ? -M2PGeo::Vector3{ vertex->normal } : M2PGeo::Vector3{ vertex->normal };
 
 		if (g_config.isObj())
 		{
 			file << std::format("{:.6f} {:.6f} {:.6f}\t", pos.x, -pos.z, pos.y);
 			file << std::format("{:.6f} {:.6f} {:.6f}\t", normal.x, -normal.z, normal.y);
-			file << std::format("{:.6f} {:.6f}", vertex.uv.x, vertex.uv.y + 1);
+			file << std::format("{:.6f} {:.6f}", vertex->uv[0], vertex->uv[1] + 1);
 		}
 		else
 		{
 			file << std::format("{:.6f} {:.6f} {:.6f}\t", pos.x, pos.y, pos.z);
 			file << std::format("{:.6f} {:.6f} {:.6f}\t", normal.x, normal.y, normal.z);
-			file << std::format("{:.6f} {:.6f}", vertex.uv.x, vertex.uv.y + 1);
+			file << std::format("{:.6f} {:.6f}", vertex->uv[0], vertex->uv[1] + 1);
 		}
 		file << "\n";
 	}
@@ -132,17 +133,23 @@ static inline bool writeSmd(const ModelData& model)
 
 	file << "version 1\nnodes\n0 \"root\" -1\nend\nskeleton\ntime 0\n0 0 0 0 0 0 0\nend\ntriangles\n";
 
-	for (const auto& pFace : model.mesh.faces)
+	const M2PHalfEdge::FlatMesh& mesh = model.flatMesh;
+
+	std::vector<std::string> materials;
+	materials.reserve(mesh.textureNames.size());
+	for (const std::string& textureName : mesh.textureNames)
+		materials.push_back(M2PUtils::toLowerCase(textureName) + ".bmp\n");
+
+	for (std::uint32_t face = 0; face < mesh.numFaces(); ++face)
 	{
-		if (!pFace)
-			continue;
+		const std::string& material = materials[mesh.faceTextures[face]];
 
-		file << M2PUtils::toLowerCase(pFace->textureName) << ".bmp\n";
-		writeSmdFace(file, pFace->vertices, false);
-		if (pFace->flipped)
+		file << material;
+		writeSmdFace(file, mesh, face, false);
+		if (mesh.faceFlipped[face])
 		{
-			file << M2PUtils::toLowerCase(pFace->textureName) << ".bmp\n";
-			writeSmdFace(file, pFace->vertices, true);
+			file << material;
+			writeSmdFace(file, mesh, face, true);
 		}
 	}
 	file << "end\n";
@@ -243,7 +250,7 @@ static inline bool writeQc(const ModelData& model)
 	return true;
 }
 
-static inline void generateClip(std::ofstream& file, M2PEntity::Entity& entity, const std::unordered_map<std::string, M2PEntity::Entity*>& parentEntities)
+static inline void generateClip(M2PUtils::BufferedWriter& writer, M2PEntity::Entity& entity, const std::unordered_map<std::string, M2PEntity::Entity*>& parentEntities)
 {
 	int clipGenType = entity.getKeyInt("clip_type");
 	if (clipGenType == 0) return;
@@ -252,7 +259,7 @@ static inline void generateClip(std::ofstream& file, M2PEntity::Entity& entity,
 	bool isCustom = bb != Bounds::zero();
 	FP scale;
 
-	if (entity.hasKey("parent_model") && !(entity.getKeyInt("spawnflags") & Spawnflags::IS_SUBMODEL))
+	if (entity.hasKey("parent_model") && !(entity.getKeyInt("spawnflags") & M2PEntity::Spawnflags::IS_SUBMODEL))
 	{
 		M2PEntity::Entity& parent = *parentEntities.at(entity.getKey("parent_model"));
 
@@ -307,29 +314,29 @@ static inline void generateClip(std::ofstream& file, M2PEntity::Entity& entity,
 	if (boundsSize.x < g_config.clipThreshold && boundsSize.y < g_config.clipThreshold && boundsSize.z < g_config.clipThreshold)
 		return;
 
-	file << "{\n\"classname\" \"func_detail\"\n"
-		<< "\"zhlt_detaillevel\" \"0\"\n\"zhlt_chopdown\" \"0\"\n"
-		<< "\"zhlt_chopup\" \"0\"\n\"zhlt_coplanarpriority\" \"1\"\n"
-		<< "\"zhlt_clipnodedetaillevel\" \"1\"\n{\n";
+	writer.write("{\n\"classname\" \"func_detail\"\n"
+		"\"zhlt_detaillevel\" \"0\"\n\"zhlt_chopdown\" \"0\"\n"
+		"\"zhlt_chopup\" \"0\"\n\"zhlt_coplanarpriority\" \"1\"\n"
+		"\"zhlt_clipnodedetaillevel\" \"1\"\n{\n");
 
 	switch (clipGenType)
 	{
 	case ClipGenType::BOX:
-		file << std::format(
+		writer.write(std::format(
 			"( {3:.6g} {4:.6g} {5:.6g} ) ( {3:.6g} {4:.6g} {2:.6g} ) ( {3:.6g} {1:.6g} {5:.6g} ) CLIP [ 0 1 0 0 ] [ 0 0 -1 0 ] 0 1 1\n"\
 			"( {0:.6g} {1:.6g} {5:.6g} ) ( {0:.6g} {1:.6g} {2:.6g} ) ( {0:.6g} {4:.6g} {5:.6g} ) CLIP [ 0 1 0 0 ] [ 0 0 -1 0 ] 0 1 1\n"\
 			"( {3:.6g} {1:.6g} {5:.6g} ) ( {3:.6g} {1:.6g} {2:.6g} ) ( {0:.6g} {1:.6g} {5:.6g} ) CLIP [ 1 0 0 0 ] [ 0 0 -1 0 ] 0 1 1\n"\
 			"( {0:.6g} {4:.6g} {5:.6g} ) ( {0:.6g} {4:.6g} {2:.6g} ) ( {3:.6g} {4:.6g} {5:.6g} ) CLIP [ 1 0 0 0 ] [ 0 0 -1 0 ] 0 1 1\n"\
 			"( {0:.6g} {4:.6g} {2:.6g} ) ( {0:.6g} {1:.6g} {2:.6g} ) ( {3:.6g} {4:.6g} {2:.6g} ) CLIP [ 1 0 0 0 ] [ 0 -1 0 0 ] 0 1 1\n"\
 			"( {3:.6g} {1:.6g} {5:.6g} ) ( {0:.6g} {1:.6g} {5:.6g} ) ( {3:.6g} {4:.6g} {5:.6g} ) CLIP [ 1 0 0 0 ] [ 0 -1 0 0 ] 0 1 1\n",
-			bb.min.x, bb.min.y, bb.min.z, bb.max.x, bb.max.y, bb.max.z);
+			bb.min.x, bb.min.y, bb.min.z, bb.max.x, bb.max.y, bb.max.z));
 		break;
 	case ClipGenType::CYLINDER:
 		Vector3 boundsCornerSize = boundsSize * .5 * c_SIN45;
 		Vector3 center = (bb.min + bb.max) / 2;
 		Bounds bc{ center - boundsCornerSize, center + boundsCornerSize };
 
-		file << std::format(
+		writer.write(std::format(
 			"( {12:.6g} {1:.6g} {2:.6g} ) ( {9:.6g} {7:.6g} {2:.6g} ) ( {6:.6g} {7:.6g} {2:.6g} ) CLIP [ 1 0 0 0 ] [ 0 -1 0 0 ] 0 1 1\n"\
 			"( {9:.6g} {10:.6g} {5:.6g} ) ( {3:.6g} {13:.6g} {5:.6g} ) ( {12:.6g} {4:.6g} {5:.6g} ) CLIP [ 1 0 0 0 ] [ 0 -1 0 0 ] 0 1 1\n"\
 			"( {9:.6g} {7:.6g} {2:.6g} ) ( {9:.6g} {7:.6g} {5:.6g} ) ( {3:.6g} {13:.6g} {2:.6g} ) CLIP [ 0 1 0 0 ] [ 0 0 -1 0 ] 0 1 1\n"\
@@ -342,334 +349,430 @@ static inline void generateClip(std::ofstream& file, M2PEntity::Entity& entity,
 			"( {3:.6g} {13:.6g} {2:.6g} ) ( {3:.6g} {13:.6g} {5:.6g} ) ( {9:.6g} {10:.6g} {2:.6g} ) CLIP [ 0 1 0 0 ] [ 0 0 -1 0 ] 0 1 1\n",
 			bb.min.x, bb.min.y, bb.min.z, bb.max.x, bb.max.y, bb.max.z,
 			bc.min.x, bc.min.y, bc.min.z, bc.max.x, bc.max.y, bc.max.z,
-			center.x, center.y, center.z);
+			center.x, center.y, center.z));
 		break;
 	}
 
-	file << "}\n}\n";
+	writer.write("}\n}\n");
 }
 
 
-std::unordered_map<std::string, ModelData> M2PExport::prepareModels(M2PEntity::BaseReader& reader, const std::string& _filename)
+/**
+ * Models built from a reader's entities, along with what naming them needs
+ */
+struct ModelSet
 {
-	int n = 0;
-	std::unordered_map<std::string, ModelData> modelsMap;
+	std::unordered_map<std::string, ModelData> models;
+	/** Model names in the order they were first added to */
+	std::vector<std::string> order;
 	std::unordered_map<std::string, unsigned int> submodelIndices;
+	/** Models already written out by streamModels */
+	std::unordered_set<std::string> written;
+	std::string filename;
+	std::string sharedName;
+	int n = 0;
+	/** Where info messages go instead of the log, if set */
+	std::vector<std::string>* messages = nullptr;
+
+	ModelSet(const std::string& _filename)
+		: filename(_filename.empty() ? g_config.inputFilepath.stem().string() : _filename)
+		, sharedName(!g_config.outputName.empty() ? g_config.outputName : filename) {}
+};
+
+/**
+ * Whether a model name could be given to a later entity as well.
+ * Unnamed and renamed own models are named <name>_<number>, and unnamed ones share that name.
+ */
+static inline bool isGeneratedName(const std::string& name)
+{
+	const size_t separator = name.find_last_of('_');
+	if (separator == std::string::npos || separator + 1 == name.size())
+		return false;
+	return std::all_of(name.begin() + separator + 1, name.end(), [](unsigned char c) { return std::isdigit(c); });
+}
+
+static inline void logInfo(ModelSet& set, const std::string& message)
+{
+	if (set.messages)
+		set.messages->push_back(message);
+	else
+		logger.info(message);
+}
+
+/**
+ * Adds an entity's brushes to the model it belongs to, creating the model if needed
+ * @param outOwnModel Whether no later entity can add to the model, so it can be written right away
+ * @return The model the entity was added to, or nullptr if it adds no geometry
+ */
+static ModelData* prepareEntity(ModelSet& set, M2PEntity::Entity& entity, M2PEntity::BaseReader& reader, bool& outOwnModel)
+{
 	std::string keyvalue;
 	keyvalue.reserve(256);
 
-	for (std::unique_ptr<M2PEntity::Entity>& entity : reader.entities)
-	{
-		bool isWorldspawn = entity->classname == "worldspawn";
-		bool isFuncM2P = entity->classname == "func_map2prop";
+	bool isWorldspawn = entity.classname == "worldspawn";
+	bool isFuncM2P = entity.classname == "func_map2prop";
 
-		if (isWorldspawn)
+	if (isWorldspawn)
+	{
+		if (!g_config.isMap())
 		{
-			if (!g_config.isMap())
-			{
-				std::string wads;
-				wads.reserve(1024);
-				for (int i = 0; i < reader.wadHandler.usedWads.size(); ++i) {
-					fs::path wadPath = reader.wadHandler.usedWads[i];
-					wadPath = fs::absolute(wadPath);
-					std::string wadStr = "/" + fs::relative(wadPath, wadPath.root_path()).string();
-					std::replace(wadStr.begin(), wadStr.end(), '\\', '/');
-					wads.append(wadStr);
-					if (i < reader.wadHandler.usedWads.size() - 1)
-						wads.append(";");
-				}
-				entity->keyvalues.emplace_back("wad", wads);
+			std::string wads;
+			wads.reserve(1024);
+			for (int i = 0; i < reader.wadHandler.usedWads.size(); ++i) {
+				fs::path wadPath = reader.wadHandler.usedWads[i];
+				wadPath = fs::absolute(wadPath);
+				std::string wadStr = "/" + fs::relative(wadPath, wadPath.root_path()).string();
+				std::replace(wadStr.begin(), wadStr.end(), '\\', '/');
+				wads.append(wadStr);
+				if (i < reader.wadHandler.usedWads.size() - 1)
+					wads.append(";");
 			}
-			entity->setKey(c_NOTE_KEY, c_NOTE_VALUE);
+			entity.keyvalues.emplace_back("wad", wads);
 		}
+		entity.setKey(c_NOTE_KEY, c_NOTE_VALUE);
+	}
 
-		if (entity->brushes.empty())
-			continue;
+	if (entity.brushes.empty())
+		return nullptr;
 
-		if (g_config.mapcompile && !isFuncM2P)
-			continue;
+	if (g_config.mapcompile && !isFuncM2P)
+		return nullptr;
 
-		std::string filename = _filename.empty() ? g_config.inputFilepath.stem().string() : _filename;
-		std::string outname = !g_config.outputName.empty() ? g_config.outputName : filename;
-		bool ownModel = false;
-		std::string parent = "";
-		std::string subdir = "";
+	const std::string& filename = set.filename;
+	std::string outname = !g_config.outputName.empty() ? g_config.outputName : filename;
+	bool ownModel = false;
+	std::string parent = "";
+	std::string subdir = "";
 
-		if (isFuncM2P)
-		{
-			if (entity->getKeyInt("spawnflags") & Spawnflags::DISABLE)
-				continue;
+	if (isFuncM2P)
+	{
+		if (entity.getKeyInt("spawnflags") & M2PEntity::Spawnflags::DISABLE)
+			return nullptr;
 
-			keyvalue = entity->getKey("parent_model");
-			if (!keyvalue.empty())
+		keyvalue = entity.getKey("parent_model");
+		if (!keyvalue.empty())
+		{
+			if (entity.getKeyInt("spawnflags") & M2PEntity::Spawnflags::IS_SUBMODEL)
 			{
-				if (entity->getKeyInt("spawnflags") & Spawnflags::IS_SUBMODEL)
-				{
-					parent = keyvalue;
-					if (!submodelIndices.contains(keyvalue))
-						submodelIndices[keyvalue] = 1;
-					else
-						++submodelIndices[keyvalue];
-					entity->setKey("body", std::to_string(submodelIndices[keyvalue]));
-					stats.countSubmodels++;
-				}
+				parent = keyvalue;
+				if (!set.submodelIndices.contains(keyvalue))
+					set.submodelIndices[keyvalue] = 1;
 				else
+					++set.submodelIndices[keyvalue];
+				entity.setKey("body", std::to_string(set.submodelIndices[keyvalue]));
+				stats.countSubmodels++;
+			}
+			else
+			{
+				for (const auto& brush : entity.brushes)
 				{
-					for (const auto& brush : entity->brushes)
+					if (brush->faces.empty())
+						continue;
+
+					if (brush->isToolBrush(M2PEntity::ToolTexture::ORIGIN))
 					{
-						if (brush->faces.empty())
-							continue;
-
-						if (brush->isToolBrush(M2PEntity::ToolTexture::ORIGIN))
-						{
-							Vector3 ori = brush->getCenter();
-							entity->setKey("origin", std::format("{:.6g} {:.6g} {:.6g}", ori.x, ori.y, ori.z));
-							break;
-						}
+						Vector3 ori = brush->getCenter();
+						entity.setKey("origin", std::format("{:.6g} {:.6g} {:.6g}", ori.x, ori.y, ori.z));
+						break;
 					}
-					stats.countClones++;
-					continue;
 				}
+				stats.countClones++;
+				return nullptr;
 			}
+		}
 
-			if (g_config.mapcompile || entity->getKeyInt("own_model") > 0)
+		if (g_config.mapcompile || entity.getKeyInt("own_model") > 0)
+		{
+			ownModel = true;
+			outname = std::format("{}_{}", filename, set.n);
+			keyvalue = entity.getKey("outname");
+			if (!keyvalue.empty())
 			{
-				ownModel = true;
-				outname = std::format("{}_{}", filename, n);
-				keyvalue = entity->getKey("outname");
-				if (!keyvalue.empty())
+				outname = keyvalue;
+				M2PUtils::replaceToken(outname, ".mdl", "");
+				if (set.models.contains(outname))
 				{
-					outname = keyvalue;
-					M2PUtils::replaceToken(outname, ".mdl", "");
-					if (modelsMap.contains(outname))
-					{
-						outname = std::format("{}_{}", outname, n);
-						++n;
-					}
+					outname = std::format("{}_{}", outname, set.n);
+					++set.n;
 				}
 			}
+		}
 
-			keyvalue = entity->getKey("subdir");
-			if (!keyvalue.empty())
-				subdir = keyvalue;
+		keyvalue = entity.getKey("subdir");
+		if (!keyvalue.empty())
+			subdir = keyvalue;
 
-			fs::path parentFolder = g_config.extractDir() / subdir;
+		fs::path parentFolder = g_config.extractDir() / subdir;
 
-			if (!fs::is_directory(parentFolder))
-				fs::create_directories(parentFolder);
+		if (!fs::is_directory(parentFolder))
+			fs::create_directories(parentFolder);
 
-			std::string modelPath = ("models" / g_config.outputDir / subdir / (outname + ".mdl")).string();
-			std::replace(modelPath.begin(), modelPath.end(), '\\', '/');
-			entity->setKey("model", modelPath);
-		}
+		std::string modelPath = ("models" / g_config.outputDir / subdir / (outname + ".mdl")).string();
+		std::replace(modelPath.begin(), modelPath.end(), '\\', '/');
+		entity.setKey("model", modelPath);
+	}
 
 
-		float scale = g_config.qcScale;
-		float rotation = g_config.qcRotate;
-		float smoothing = g_config.smoothing;
-		bool chrome = g_config.renameChrome;
-		std::string qcFlags = "";
+	float scale = g_config.qcScale;
+	float rotation = g_config.qcRotate;
+	float smoothing = g_config.smoothing;
+	bool chrome = g_config.renameChrome;
+	std::string qcFlags = "";
 
-		if (isWorldspawn || ownModel)
+	if (isWorldspawn || ownModel)
+	{
+		if (!(keyvalue = entity.getKey("scale")).empty())
 		{
-			if (!(keyvalue = entity->getKey("scale")).empty())
-			{
-				scale = std::stof(keyvalue);
-				if (scale == 0)
-					scale = 1.0;
-			}
+			scale = std::stof(keyvalue);
+			if (scale == 0)
+				scale = 1.0;
+		}
 
-			if (!(keyvalue = entity->getKey("angles")).empty())
-			{
-				std::vector<std::string> angles = M2PUtils::split(keyvalue, ' ');
-				if (angles.size() == 1)
-					rotation = fmod(rotation + std::stof(angles[0]), 360.0f);
-				else if (angles.size() > 2)
-					rotation = fmod(rotation + std::stof(angles[1]), 360.0f);
-			}
+		if (!(keyvalue = entity.getKey("angles")).empty())
+		{
+			std::vector<std::string> angles = M2PUtils::split(keyvalue, ' ');
+			if (angles.size() == 1)
+				rotation = fmod(rotation + std::stof(angles[0]), 360.0f);
+			else if (angles.size() > 2)
+				rotation = fmod(rotation + std::stof(angles[1]), 360.0f);
+		}
 
-			if (!(keyvalue = entity->getKey("smoothing")).empty())
-				smoothing = std::stof(keyvalue);
+		if (!(keyvalue = entity.getKey("smoothing")).empty())
+			smoothing = std::stof(keyvalue);
 
-			if (!(keyvalue = entity->getKey("qc_flags")).empty())
-				qcFlags = keyvalue;
+		if (!(keyvalue = entity.getKey("qc_flags")).empty())
+			qcFlags = keyvalue;
 
-			chrome = entity->getKeyInt("chrome") == 1 || entity->getKeyInt("spawnflags") & Spawnflags::RENAME_CHROME;
-		}
+		chrome = entity.getKeyInt("chrome") == 1 || entity.getKeyInt("spawnflags") & M2PEntity::Spawnflags::RENAME_CHROME;
+	}
 
-		
-		if (!modelsMap.contains(outname))
-		{
-			modelsMap[outname].targetname = entity->getKey("targetname");
-			modelsMap[outname].outname = outname;
-			modelsMap[outname].subdir = subdir;
-			modelsMap[outname].scale = scale;
-			modelsMap[outname].rotation = rotation;
-			modelsMap[outname].smoothing = smoothing;
-			modelsMap[outname].renameChrome = chrome;
-			modelsMap[outname].qcFlags = qcFlags;
-			modelsMap[outname].parent = parent;
-		}
+	
+	if (!set.models.contains(outname))
+	{
+		set.order.push_back(outname);
+		set.models[outname].targetname = entity.getKey("targetname");
+		set.models[outname].outname = outname;
+		set.models[outname].subdir = subdir;
+		set.models[outname].scale = scale;
+		set.models[outname].rotation = rotation;
+		set.models[outname].smoothing = smoothing;
+		set.models[outname].renameChrome = chrome;
+		set.models[outname].qcFlags = qcFlags;
+		set.models[outname].parent = parent;
+	}
 
-		bool originFound = false, boundsFound = false, clipFound = false;
-		for (const auto& brush : entity->brushes)
-		{
+	bool originFound = false, boundsFound = false, clipFound = false;
+	for (const auto& brush : entity.brushes)
+	{
 
-			// Look for ORIGIN brushes, use first found
-			if (modelsMap[outname].offset == Vector3::zero() && brush->isToolBrush(M2PEntity::ToolTexture::ORIGIN))
+		// Look for ORIGIN brushes, use first found
+		if (set.models[outname].offset == Vector3::zero() && brush->isToolBrush(M2PEntity::ToolTexture::ORIGIN))
+		{
+			if (originFound)
 			{
-				if (originFound)
-				{
-					logger.info(std::format("Multiple ORIGIN brushes found in {} near ({})", entity->classname, brush->getCenter()));
-					continue;
-				}
-				if (isWorldspawn || ownModel)
-				{
-					Vector3 origin = geometricCenter(brush->getBounds());
-					modelsMap[outname].offset = origin;
-					entity->setKey("origin", std::format("{}", origin));
-				}
-				originFound = true;
+				logInfo(set, std::format("Multiple ORIGIN brushes found in {} near ({})", entity.classname, brush->getCenter()));
 				continue;
 			}
+			if (isWorldspawn || ownModel)
+			{
+				Vector3 origin = geometricCenter(brush->getBounds());
+				set.models[outname].offset = origin;
+				entity.setKey("origin", std::format("{}", origin));
+			}
+			originFound = true;
+			continue;
+		}
 
-			// Look for BOUNDINGBOX brushes, use first found
-			if (modelsMap[outname].bounds == Bounds::zero()
-				&& brush->isToolBrush(M2PEntity::ToolTexture::BOUNDINGBOX))
+		// Look for BOUNDINGBOX brushes, use first found
+		if (set.models[outname].bounds == Bounds::zero()
+			&& brush->isToolBrush(M2PEntity::ToolTexture::BOUNDINGBOX))
+		{
+			if (boundsFound)
 			{
-				if (boundsFound)
-				{
-					logger.info(std::format("Multiple BOUNDINGBOX brushes found in {} near ({})", entity->classname, brush->getCenter()));
-					continue;
-				}
-				if (isWorldspawn || ownModel)
-				{
-					modelsMap[outname].bounds = brush->getBounds();
-				}
-				boundsFound = true;
+				logInfo(set, std::format("Multiple BOUNDINGBOX brushes found in {} near ({})", entity.classname, brush->getCenter()));
 				continue;
 			}
-			
-			// Look for CLIP brushes, use first found
-			if (modelsMap[outname].clip == Bounds::zero()
-				&& brush->isToolBrush(M2PEntity::ToolTexture::CLIP))
+			if (isWorldspawn || ownModel)
 			{
-				if (clipFound)
-				{
-					logger.info(std::format("Multiple CLIP brushes found in {} near ({})", entity->classname, brush->getCenter()));
-					continue;
-				}
-				if (isWorldspawn || ownModel)
-				{
-					modelsMap[outname].clip = brush->getBounds();
-				}
-				clipFound = true;
-				continue;
+				set.models[outname].bounds = brush->getBounds();
 			}
-			
-			// Look for CLIPBEVEL brushes
-			if (brush->isToolBrush(M2PEntity::ToolTexture::CLIPBEVEL))
+			boundsFound = true;
+			continue;
+		}
+		
+		// Look for CLIP brushes, use first found
+		if (set.models[outname].clip == Bounds::zero()
+			&& brush->isToolBrush(M2PEntity::ToolTexture::CLIP))
+		{
+			if (clipFound)
 			{
-				if (isWorldspawn || ownModel)
-				{
-					modelsMap[outname].neverSmooth.push_back(brush->getBounds());
-				}
+				logInfo(set, std::format("Multiple CLIP brushes found in {} near ({})", entity.classname, brush->getCenter()));
 				continue;
 			}
-			
-			// Look for BEVEL brushes
-			if (brush->isToolBrush(M2PEntity::ToolTexture::BEVEL))
+			if (isWorldspawn || ownModel)
 			{
-				if (isWorldspawn || ownModel)
+				set.models[outname].clip = brush->getBounds();
+			}
+			clipFound = true;
+			continue;
+		}
+		
+		// Look for CLIPBEVEL brushes
+		if (brush->isToolBrush(M2PEntity::ToolTexture::CLIPBEVEL))
+		{
+			if (isWorldspawn || ownModel)
+			{
+				set.models[outname].neverSmooth.push_back(brush->getBounds());
+			}
+			continue;
+		}
+		
+		// Look for BEVEL brushes
+		if (brush->isToolBrush(M2PEntity::ToolTexture::BEVEL))
+		{
+			if (isWorldspawn || ownModel)
+			{
+				set.models[outname].alwaysSmooth.push_back(brush->getBounds());
+			}
+			continue;
+		}
+
+		bool hasContentWater = brush->hasContentWater();
+
+		for (const M2PEntity::Face& face : brush->faces)
+		{
+			if (M2PWad3::Wad3Handler::isSkipTexture(face.texture.name) || M2PWad3::Wad3Handler::isToolTexture(face.texture.name))
+				continue;
+
+			if (face.texture.name.starts_with('{'))
+				set.models[outname].maskedTextures.insert(face.texture.name);
+
+			ModelData& currentModel = set.models[outname];
+
+			// Indexed faces already know which vertices are shared, so only new indices need welding
+			if (face.coordIndices.size() == face.vertices.size())
+			{
+				for (const auto& [a, b, c] : earClipIndices(face.vertices, face.normal))
 				{
-					modelsMap[outname].alwaysSmooth.push_back(brush->getBounds());
+					const Triangle triangle{
+						.flipped = false,
+						.normal = face.normal,
+						.vertices = { face.vertices[a], face.vertices[b], face.vertices[c] }
+					};
+					currentModel.mesh.addTriangle(
+						triangle,
+						{ face.coordIndices[a], face.coordIndices[b], face.coordIndices[c] },
+						face.texture,
+						hasContentWater
+					);
 				}
 				continue;
 			}
 
-			bool hasContentWater = brush->hasContentWater();
-
-			for (const M2PEntity::Face& face : brush->faces)
-			{
-				if (M2PWad3::Wad3Handler::isSkipTexture(face.texture.name) || M2PWad3::Wad3Handler::isToolTexture(face.texture.name))
-					continue;
+			const std::vector<Triangle> triangles = earClip(face.vertices, face.normal);
 
-				if (face.texture.name.starts_with('{'))
-					modelsMap[outname].maskedTextures.insert(face.texture.name);
+			for (const Triangle& triangle : triangles)
+				currentModel.mesh.addTriangle(triangle, face.texture, hasContentWater);
+		}
+	}
 
-				ModelData& currentModel = modelsMap[outname];
+	if (set.models[outname].offset == Vector3::zero() && !entity.getKeyInt("use_world_origin"))
+	{
+		Vector3 aabbMin = set.models[outname].mesh.coords[0]->coord();
+		Vector3 aabbMax = set.models[outname].mesh.coords[0]->coord();
 
-				const std::vector<Triangle> triangles = earClip(face.vertices, face.normal);
+		for (const auto& vertex : set.models[outname].mesh.coords)
+		{
+			if (vertex->x < aabbMin.x) aabbMin.x = vertex->x;
+			if (vertex->y < aabbMin.y) aabbMin.y = vertex->y;
+			if (vertex->z < aabbMin.z) aabbMin.z = vertex->z;
 
-				for (const Triangle& triangle : triangles)
-					currentModel.mesh.addTriangle(triangle, face.texture, hasContentWater);
-			}
+			if (vertex->x > aabbMax.x) aabbMax.x = vertex->x;
+			if (vertex->y > aabbMax.y) aabbMax.y = vertex->y;
+			if (vertex->z > aabbMax.z) aabbMax.z = vertex->z;
 		}
 
-		if (modelsMap[outname].offset == Vector3::zero() && !entity->getKeyInt("use_world_origin"))
-		{
-			Vector3 aabbMin = modelsMap[outname].mesh.coords[0]->coord();
-			Vector3 aabbMax = modelsMap[outname].mesh.coords[0]->coord();
+		set.models[outname].offset = geometricCenter(std::vector{ aabbMin, aabbMax });
+		set.models[outname].offset.z -= (aabbMax.z - aabbMin.z) / 2;
 
-			for (const auto& vertex : modelsMap[outname].mesh.coords)
-			{
-				if (vertex->x < aabbMin.x) aabbMin.x = vertex->x;
-				if (vertex->y < aabbMin.y) aabbMin.y = vertex->y;
-				if (vertex->z < aabbMin.z) aabbMin.z = vertex->z;
+		Vector3& ori = set.models[outname].offset;
+		entity.setKey("origin", std::format("{:.6g} {:.6g} {:.6g}", ori.x, ori.y, ori.z));
+	}
 
-				if (vertex->x > aabbMax.x) aabbMax.x = vertex->x;
-				if (vertex->y > aabbMax.y) aabbMax.y = vertex->y;
-				if (vertex->z > aabbMax.z) aabbMax.z = vertex->z;
-			}
+	outOwnModel = ownModel && outname != set.sharedName && !isGeneratedName(outname);
+	return &set.models[outname];
+}
 
-			modelsMap[outname].offset = geometricCenter(std::vector{ aabbMin, aabbMax });
-			modelsMap[outname].offset.z -= (aabbMax.z - aabbMin.z) / 2;
+/**
+ * Lists every submodel in its parent, in the order the submodels were added
+ */
+static void linkSubmodels(ModelSet& set)
+{
+	for (const std::string& name : set.order)
+	{
+		const ModelData& model = set.models.at(name);
+		if (model.parent.empty())
+			continue;
 
-			Vector3& ori = modelsMap[outname].offset;
-			entity->setKey("origin", std::format("{:.6g} {:.6g} {:.6g}", ori.x, ori.y, ori.z));
+		for (auto& kv : set.models)
+		{
+			ModelData& other = kv.second;
+			if (model.parent == other.targetname)
+				other.submodels.push_back(model.outname);
 		}
 	}
+}
+
+std::unordered_map<std::string, ModelData> M2PExport::prepareModels(M2PEntity::BaseReader& reader, const std::string& _filename, std::vector<std::string>* outMessages)
+{
+	ModelSet set{ _filename };
+	set.messages = outMessages;
 
-	for (const auto& kv : modelsMap)
+	for (std::unique_ptr<M2PEntity::Entity>& entity : reader.entities)
 	{
-		const auto& model = kv.second;
-		if (!model.parent.empty())
-		{
-			for (auto& kv2 : modelsMap)
-			{
-				auto& other = kv2.second;
-				if (model.parent == other.targetname)
-					other.submodels.push_back(model.outname);
-			}
-		}
+		bool ownModel = false;
+		prepareEntity(set, *entity, reader, ownModel);
 	}
 
-	return modelsMap;
+	for (auto& kv : set.models)
+		kv.second.buildSmoothIndex();
+
+	linkSubmodels(set);
+
+	return std::move(set.models);
 }
 
-int M2PExport::processModels(std::unordered_map<std::string, ModelData>& models, bool missingTextures, std::vector<fs::path>& successes)
+void M2PExport::logMessages(const std::vector<std::string>& messages)
 {
-	int returnCodes = 0;
+	for (const std::string& message : messages)
+		logger.info(message);
+}
 
-	logger.debug("Processing %u model%c", models.size(), models.size() == 1 ? '\0' : 's');
+/**
+ * Smooths a model's mesh and writes it out as SMD
+ */
+static inline bool processModel(ModelData& model)
+{
+	renameChrome(model);
 
-	for (auto& kv : models)
-	{
-		ModelData& model = kv.second;
+	const M2PHalfEdge::AllocationStats allocations = model.mesh.allocationStats();
+	logger.debug(std::format("{}: {} mesh nodes from {} heap allocations ({} bytes)",
+		model.outname, allocations.nodes, allocations.heapAllocations, allocations.heapBytes));
 
-		renameChrome(model);
-		applySmooth(model);
+	if (const size_t nonManifold = model.mesh.nonManifoldEdges())
+		logger.info(std::format("{} has {} non-manifold edge{}, these are never smoothed", model.outname, nonManifold, nonManifold == 1 ? "" : "s"));
 
-		model.applyOffset();
+	model.flatten();
+	applySmooth(model);
 
-		if (!writeSmd(model))
-			return 1;
+	model.applyOffset();
 
-		if (!writeQc(model))
-			return 1;
-	}
+	return writeSmd(model);
+}
 
-	logger.info("Finished processing %u model%c", models.size(), models.size() == 1 ? '\0' : 's');
+static inline int compileModels(std::unordered_map<std::string, ModelData>& models, bool missingTextures, std::vector<fs::path>& successes)
+{
+	int returnCodes = 0;
 
 	if (!g_config.autocompile)
 		return 0;
@@ -711,9 +814,92 @@ int M2PExport::processModels(std::unordered_map<std::string, ModelData>& models,
 	return returnCodes;
 }
 
-void M2PExport::rewriteMap(std::vector<std::unique_ptr<M2PEntity::Entity>> &entities)
+int M2PExport::processModels(std::unordered_map<std::string, ModelData>& models, bool missingTextures, std::vector<fs::path>& successes)
+{
+	logger.debug("Processing %u model%c", models.size(), models.size() == 1 ? '\0' : 's');
+
+	for (auto& kv : models)
+	{
+		ModelData& model = kv.second;
+
+		if (!processModel(model))
+			return 1;
+
+		if (!writeQc(model))
+			return 1;
+	}
+
+	logger.info("Finished processing %u model%c", models.size(), models.size() == 1 ? '\0' : 's');
+
+	return compileModels(models, missingTextures, successes);
+}
+
+int M2PExport::streamModels(M2PFormat::MapReader& reader, std::vector<fs::path>& successes, size_t& outNumModels)
+{
+	ModelSet set{ "" };
+	outNumModels = 0;
+
+	while (M2PEntity::Entity* entity = reader.readNextEntity())
+	{
+		bool ownModel = false;
+		ModelData* model = prepareEntity(set, *entity, reader, ownModel);
+		outNumModels = set.models.size();
+
+		// The brushes are meshed now, --mapcompile only needs their raw text and bounds back
+		// and otherwise only worldspawn is kept, for its keys
+		if (g_config.mapcompile || reader.entities.size() == 1)
+		{
+			entity->releaseFaces();
+		}
+		else
+		{
+			reader.entities.pop_back();
+		}
+
+		if (!model || !ownModel)
+			continue;
+
+		model->buildSmoothIndex();
+		if (!processModel(*model))
+			return 1;
+		model->release();
+		set.written.insert(model->outname);
+	}
+
+	// Shared and generated names can take geometry from several entities, so they wait until everything is read
+	for (const std::string& name : set.order)
+	{
+		ModelData& model = set.models.at(name);
+		if (set.written.contains(name))
+			continue;
+
+		model.buildSmoothIndex();
+		if (!processModel(model))
+			return 1;
+		model.release();
+	}
+
+	linkSubmodels(set);
+
+	// QC files list their submodels, so they wait until every model is known
+	for (const std::string& name : set.order)
+	{
+		if (!writeQc(set.models.at(name)))
+			return 1;
+	}
+
+	if (outNumModels == 0)
+		return 0;
+
+	logger.info("Finished processing %u model%c", outNumModels, outNumModels == 1 ? '\0' : 's');
+
+	return compileModels(set.models, reader.hasMissingTextures(), successes);
+}
+
+void M2PExport::rewriteMap(M2PEntity::BaseReader& reader)
 {
 	stats.clear();
+	std::vector<std::unique_ptr<M2PEntity::Entity>>& entities = reader.entities;
 
 	std::string stem = g_config.inputFilepath.stem().string();
 
@@ -759,8 +945,12 @@ void M2PExport::rewriteMap(std::vector<std::unique_ptr<M2PEntity::Entity>> &enti
 
 	logger.info("Writing modified MAP as " + filepath.string());
 
-	std::ofstream file{ filepath };
-	if (!file.is_open() || !file.good())
+	// Brushes read from the mapped input keep pointing into it while it is overwritten
+	if (reader.source)
+		reader.source->detach();
+
+	M2PUtils::BufferedWriter writer{ filepath };
+	if (!writer.isOpen())
 	{
 		logger.error("Could not open \"" + filepath.string() + "\" for writing");
 		return;
@@ -771,12 +961,12 @@ void M2PExport::rewriteMap(std::vector<std::unique_ptr<M2PEntity::Entity>> &enti
 	{
 		if (entity->classname != "func_map2prop")
 		{
-			file << entity->toString();
+			entity->write(writer);
 			continue;
 		}
 
 		// Entity is disabled, skip
-		if (entity->getKeyInt("spawnflags") & Spawnflags::DISABLE)
+		if (entity->getKeyInt("spawnflags") & M2PEntity::Spawnflags::DISABLE)
 			continue;
 
 
@@ -795,7 +985,7 @@ void M2PExport::rewriteMap(std::vector<std::unique_ptr<M2PEntity::Entity>> &enti
 
 		stats.entitiesReplaced++;
 
-		generateClip(file, *entity, parentEntities);
+		generateClip(writer, *entity, parentEntities);
 
 
 		std::string newClass = entity->hasKey("convert_to") ? entity->getKey("convert_to") : "env_sprite";
@@ -821,7 +1011,13 @@ void M2PExport::rewriteMap(std::vector<std::unique_ptr<M2PEntity::Entity>> &enti
 		for (const auto& skipKey : m2pKeys)
 			entity->removeKey(skipKey);
 
-		entity->writeToMap(file);
+		entity->writeToMap(writer);
+	}
+
+	if (!writer.flush())
+	{
+		logger.error("Something went wrong when writing to " + filepath.string());
+		return;
 	}
 
 	stats.write();
@@ -850,10 +1046,10 @@ bool M2PExport::MapCompileStats::write()
 	}
 
 	file << "Map2Prop macompile statitics:\n\n"
-		<< std::format("| {:<25}|{:>11} |\n", "Models created:", stats.countModels)
-		<< std::format("| {:<25}|{:>11} |\n", "Submodels created:", stats.countSubmodels)
-		<< std::format("| {:<25}|{:>11} |\n", "Template clones:", stats.countClones)
-		<< std::format("| {:<25}|{:>11} |\n", "Entities replaced:", stats.entitiesReplaced);
+		<< std::format("| {:<25}|{:>11} |\n", "Models created:", stats.countModels.load())
+		<< std::format("| {:<25}|{:>11} |\n", "Submodels created:", stats.countSubmodels.load())
+		<< std::format("| {:<25}|{:>11} |\n", "Template clones:", stats.countClones.load())
+		<< std::format("| {:<25}|{:>11} |\n", "Entities replaced:", stats.entitiesReplaced.load());
 
 	bool res = file.good();
 	file.close();
@@ -3,25 +3,22 @@
 #include <fstream>
 #include <cmath>
 #include <set>
+#include <atomic>
 #include "entity.h"
 #include "geometry.h"
 #include "wad3handler.h"
 #include "halfedge.h"
+#include "flat_mesh.h"
+#include "bounds_tree.h"
+#include "map_format.h"
 
 
 namespace M2PExport
 {
-	static inline const char* c_NOTE_KEY{ "_note" };
-	static inline const char* c_NOTE_VALUE{ "Modified by Map2Prop" };
+	static inline const char* const c_NOTE_KEY{ "_note" };
+	static inline const char* const c_NOTE_VALUE{ "Modified by Map2Prop" };
 	static inline const FP c_SIN45 = static_cast<FP>(sin(std::numbers::pi / 4));
 
-	enum Spawnflags
-	{
-		DISABLE = 1,
-		IS_SUBMODEL = 2,
-		RENAME_CHROME = 4,
-	};
-
 	enum ClipGenType
 	{
 		BOX = 1,
@@ -43,37 +40,80 @@ namespace M2PExport
 		std::vector<std::string> submodels;
 		std::vector<M2PGeo::Bounds> alwaysSmooth;
 		std::vector<M2PGeo::Bounds> neverSmooth;
+		M2PGeo::BoundsTree alwaysSmoothIndex;
+		M2PGeo::BoundsTree neverSmoothIndex;
 		std::set<std::string> maskedTextures;
 		M2PHalfEdge::Mesh mesh;
+		M2PHalfEdge::FlatMesh flatMesh;
 
 		ModelData() = default;
 		ModelData(ModelData& other) = delete;
 		~ModelData() = default;
 
+		/**
+		 * Indexes the BEVEL and CLIPBEVEL bounds for the smoothing pass
+		 */
+		void buildSmoothIndex()
+		{
+			alwaysSmoothIndex = M2PGeo::BoundsTree{ alwaysSmooth };
+			neverSmoothIndex = M2PGeo::BoundsTree{ neverSmooth };
+		}
+
+		/**
+		 * Moves the finished mesh into its flat layout for smoothing and writing
+		 */
+		void flatten()
+		{
+			flatMesh = M2PHalfEdge::FlatMesh{ mesh };
+			mesh.clear();
+		}
+
 		void applyOffset()
 		{
-			for (auto& coord : mesh.coords)
-			{
-				coord->x -= offset.x;
-				coord->y -= offset.y;
-				coord->z -= offset.z;
-			}
+			flatMesh.applyOffset(offset);
+		}
+
+		/**
+		 * Frees the geometry once the SMD is written, keeping what the QC and compile steps need
+		 */
+		void release()
+		{
+			mesh.clear();
+			flatMesh = M2PHalfEdge::FlatMesh{};
+			alwaysSmoothIndex = M2PGeo::BoundsTree{};
+			neverSmoothIndex = M2PGeo::BoundsTree{};
+			std::vector<M2PGeo::Bounds>().swap(alwaysSmooth);
+			std::vector<M2PGeo::Bounds>().swap(neverSmooth);
 		}
 	};
 
 	struct MapCompileStats
 	{
-		int entitiesReplaced = 0;
-		int countModels = 0;
-		int countSubmodels = 0;
-		int countClones = 0;
+		std::atomic<int> entitiesReplaced = 0;
+		std::atomic<int> countModels = 0;
+		std::atomic<int> countSubmodels = 0;
+		std::atomic<int> countClones = 0;
 
 		void clear();
 		bool write();
 	};
 
-	std::unordered_map<std::string, ModelData> prepareModels(M2PEntity::BaseReader& reader, const std::string& _filename = "");
+	/**
+	 * @param outMessages Collects the info messages instead of logging them, so several readers
+	 * can be prepared at once and their messages logged in order with logMessages
+	 */
+	std::unordered_map<std::string, ModelData> prepareModels(M2PEntity::BaseReader& reader, const std::string& _filename = "", std::vector<std::string>* outMessages = nullptr);
+	void logMessages(const std::vector<std::string>& messages);
 	int processModels(std::unordered_map<std::string, ModelData>& models, bool missingTextures, std::vector<std::filesystem::path>& successes);
-	void rewriteMap(std::vector<std::unique_ptr<M2PEntity::Entity>>& entities);
+
+	/**
+	 * Reads, meshes and writes out the models of a MAP one entity at a time.
+	 * Models named by their entity's outname are freed as soon as their SMD is written,
+	 * so with named props memory use is bounded by the largest model rather than the whole map.
+	 * Models are named the same as with prepareModels.
+	 * @param outNumModels Number of models found
+	 */
+	int streamModels(M2PFormat::MapReader& reader, std::vector<std::filesystem::path>& successes, size_t& outNumModels);
+	void rewriteMap(M2PEntity::BaseReader& reader);
 	bool writeMapCompileStats();
 }
@@ -1,10 +1,14 @@
 #include <string>
 #include <cstring>
 #include <vector>
+#include <algorithm>
 #include "jmf_format.h"
 #include "logging.h"
 #include "utils.h"
 #include "binutils.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "config.h"
 
 static inline Logging::Logger& logger = Logging::Logger::getLogger("jmfreader");
 
@@ -13,85 +17,59 @@ using namespace M2PFormat;
 using namespace M2PGeo;
 using namespace M2PEntity;
 using namespace M2PBinUtils;
+using M2PConfig::g_config;
 
 
-std::string JmfBrush::getRaw() const
-{
-	std::string raw = "{\n";
-	raw.reserve(1024);
+static inline constexpr size_t c_BRUSHES_PER_TASK = 16;
 
-	for (const auto& face : faces)
-	{
-		Vertex x = M2PUtils::getCircular(face.vertices, -1);
-		Vertex y = M2PUtils::getCircular(face.vertices, -2);
-		Vertex z = M2PUtils::getCircular(face.vertices, -3);
-		FP ux = face.texture.rightaxis.x, uy = face.texture.rightaxis.y, uz = face.texture.rightaxis.z;
-		FP vx = face.texture.downaxis.x, vy = face.texture.downaxis.y, vz = face.texture.downaxis.z;
-		FP shiftx = face.texture.shiftx, shifty = face.texture.shifty;
-		FP r = face.texture.angle, scalex = face.texture.scalex, scaley = face.texture.scaley;
-
-		raw += std::format("( {:.6g} {:.6g} {:.6g} ) ", x.x, x.y, x.z);
-		raw += std::format("( {:.6g} {:.6g} {:.6g} ) ", y.x, y.y, y.z);
-		raw += std::format("( {:.6g} {:.6g} {:.6g} ) {} ", z.x, z.y, z.z, face.texture.name);
-
-		raw += std::format("[ {:.6g} {:.6g} {:.6g} {:.6g} ] ", ux, uy, uz, shiftx);
-		raw += std::format("[ {:.6g} {:.6g} {:.6g} {:.6g} ] ", vx, vy, vz, shifty);
-		raw += std::format("{:.6g} {:.6g} {:.6g}\n", r, scalex, scaley);
-	}
 
-	raw += "}\n";
-	return raw;
+std::string JmfBrush::getRaw() const
+{
+	M2PUtils::BufferedWriter writer;
+	writeRaw(writer);
+	return writer.str();
 }
 
-std::string JmfEntity::toString() const
+void JmfBrush::writeRaw(M2PUtils::BufferedWriter& writer) const
 {
-	std::string str;
-	str.reserve(1024);
-	str = "{\n";
+	writer.write("{\n");
 
-	for (std::pair<std::string, std::string> const& pair : keyvalues)
-	{
-		str += std::format("\"{}\" \"{}\"\n", pair.first, pair.second);
-	}
-
-	if (!brushes.empty())
+	for (const auto& face : faces)
 	{
-		for (const std::unique_ptr<Brush>& brush : brushes)
-		{
-			str += brush->getRaw();
-		}
+		writeRawFace(writer,
+			M2PUtils::getCircular(face.vertices, -1),
+			M2PUtils::getCircular(face.vertices, -2),
+			M2PUtils::getCircular(face.vertices, -3),
+			face.texture
+		);
 	}
+	for (const RawFace& face : rawFaces)
+		writeRawFace(writer, face.points[0], face.points[1], face.points[2], face.texture);
 
-	str += "}\n";
-
-	return str;
+	writer.write("}\n");
 }
 
 JmfReader::JmfReader(const std::filesystem::path& filepath, const std::filesystem::path& outputDir)
 {
 	m_filepath = filepath;
 	m_outputDir = outputDir;
-	m_file.open(filepath, std::ios::binary);
-	if (!m_file.is_open() || !m_file.good())
+	M2PUtils::MappedFile file{ filepath };
+	if (!file.isOpen())
 	{
-		m_file.close();
 		logger.error("Could not open file " + filepath.string());
 		exit(EXIT_FAILURE);
 	}
+	m_cursor = BinaryCursor{ file.view() };
 
 	parse();
-	m_file.close();
-}
-JmfReader::~JmfReader()
-{
-	if (m_file.is_open())
-		m_file.close();
+	m_cursor = BinaryCursor{};
+	resolveTextures(false);
 }
 
 void JmfReader::parse()
 {
 	char magic[4]{};
-	m_file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	m_cursor.read(magic);
 
 	if (strncmp(magic, "JHMF", 4))
 	{
@@ -99,16 +77,16 @@ void JmfReader::parse()
 		exit(EXIT_FAILURE);
 	}
 
-	m_version = readInt(m_file);
+	m_version = m_cursor.readInt();
 	if (!M2PUtils::contains(c_SUPPORTED_VERSIONS, m_version))
 	{
 		logger.error(std::format("Unsupported JMF version: {}", m_version));
 		exit(EXIT_FAILURE);
 	}
 
-	std::int32_t exportPathCount = readInt(m_file);
+	std::int32_t exportPathCount = m_cursor.readInt();
 	for (int i = 0; i < exportPathCount; ++i)
-		readIntLPString(m_file);
+		m_cursor.readIntLPString();
 
 	if (m_version >= 122)
 	{
@@ -116,118 +94,134 @@ void JmfReader::parse()
 			readBgImage();
 	}
 
-	std::int32_t groupCount = readInt(m_file);
+	std::int32_t groupCount = m_cursor.readInt();
 	for (int i = 0; i < groupCount; ++i)
 		readGroup();
 	
-	std::int32_t visgroupCount = readInt(m_file);
+	std::int32_t visgroupCount = m_cursor.readInt();
 	for (int i = 0; i < visgroupCount; ++i)
 		readVisgroup();
 
 	float cordon[2][3]{};
-	m_file.read(reinterpret_cast<char*>(&cordon), sizeof(cordon));
+	m_cursor.read(cordon);
 
-	std::int32_t cameraCount = readInt(m_file);
+	std::int32_t cameraCount = m_cursor.readInt();
 	for (int i = 0; i < cameraCount; ++i)
 		readCamera();
 	
-	std::int32_t pathCount = readInt(m_file);
+	std::int32_t pathCount = m_cursor.readInt();
 	for (int i = 0; i < pathCount; ++i)
 		readPath();
 
-	while (m_file.peek(), !m_file.eof())
-		readEntity();
+	// Entities are read as they come, only noting where each of their brushes starts
+	std::vector<BrushSlot> brushSlots;
+	while (!m_cursor.atEnd())
+		readEntity(brushSlots);
+
+	// Then the brushes, which hold nearly all of the data, are decoded in parallel
+	M2PUtils::parallelFor(brushSlots.size(), c_BRUSHES_PER_TASK, static_cast<unsigned int>(g_config.threads), [&](size_t i)
+	{
+		BinaryCursor cursor{ m_cursor.data(), brushSlots[i].offset };
+		*brushSlots[i].slot = readBrush(cursor, brushSlots[i].raw);
+	});
 }
 
 void JmfReader::readBgImage()
 {
-	std::string path = readIntLPString(m_file);
+	m_cursor.readIntLPString(); // path
 	JmfBgImage bgImage{};
-	m_file.read(reinterpret_cast<char*>(&bgImage), sizeof(JmfBgImage));
+	m_cursor.read(bgImage);
 }
 
 void JmfReader::readGroup()
 {
 	JmfGroup group{};
-	m_file.read(reinterpret_cast<char*>(&group), sizeof(JmfGroup));
+	m_cursor.read(group);
 }
 
 void JmfReader::readVisgroup()
 {
-	std::string name = readIntLPString(m_file);
+	m_cursor.readIntLPString(); // name
 	JmfVisgroup visgroup{};
-	m_file.read(reinterpret_cast<char*>(&visgroup), sizeof(JmfVisgroup));
+	m_cursor.read(visgroup);
 }
 
 void JmfReader::readCamera()
 {
 	JmfCamera camera{};
-	m_file.read(reinterpret_cast<char*>(&camera), sizeof(JmfCamera));
+	m_cursor.read(camera);
 }
 
 void JmfReader::readPath()
 {
-	readIntLPString(m_file);		// classname
-	readIntLPString(m_file);		// path name
-	readInt(m_file);				// path type
-	readInt(m_file);		    	// flags
-	m_file.seekg(4, std::ios::cur); // color
-	std::int32_t nodeCount = readInt(m_file);
+	m_cursor.readIntLPString();		// classname
+	m_cursor.readIntLPString();		// path name
+	m_cursor.readInt();				// path type
+	m_cursor.readInt();		    	// flags
+	m_cursor.skip(4); // color
+	std::int32_t nodeCount = m_cursor.readInt();
 	for (int i = 0; i < nodeCount; ++i)
 		readPathNode();
 }
 
 void JmfReader::readPathNode()
 {
-	readIntLPString(m_file);		// name override
-	readIntLPString(m_file);		// fire on pass
-	m_file.seekg(sizeof(float[3]), std::ios::cur); // position
-	m_file.seekg(sizeof(float[3]), std::ios::cur); // angles
-	readInt(m_file);				// flags
-	std::int32_t kvCount = readInt(m_file);
+	m_cursor.readIntLPString();		// name override
+	m_cursor.readIntLPString();		// fire on pass
+	m_cursor.skip(sizeof(float[3])); // position
+	m_cursor.skip(sizeof(float[3])); // angles
+	m_cursor.readInt();				// flags
+	std::int32_t kvCount = m_cursor.readInt();
 	for (int i = 0; i < kvCount; ++i)
 	{
-		readIntLPString(m_file); // key
-		readIntLPString(m_file); // value
+		m_cursor.readIntLPString(); // key
+		m_cursor.readIntLPString(); // value
 	}
 }
 
-void JmfReader::readEntity()
+void JmfReader::readEntity(std::vector<BrushSlot>& brushSlots)
 {
-	entities.emplace_back(std::make_unique<JmfEntity>());
+	entities.emplace_back(std::make_unique<Entity>());
 	Entity& entity = *entities.back();
 
-	entity.classname = readIntLPString(m_file);
+	entity.classname = m_cursor.readIntLPString();
 	entity.keyvalues.emplace_back("classname", entity.classname);
 
 	if (entity.classname == "worldspawn")
 		entity.keyvalues.emplace_back("mapversion", "220");
 
 	JmfEntityHeader header{};
-	m_file.read(reinterpret_cast<char*>(&header), sizeof(JmfEntityHeader));
+	m_cursor.read(header);
 	
 	// Special JACK attributes, ignore
 	for (int i = 0; i < 13; ++i)
-		readIntLPString(m_file);
+		m_cursor.readIntLPString();
 
 	JmfEntityBody body{};
-	m_file.read(reinterpret_cast<char*>(&body), sizeof(JmfEntityBody));
+	m_cursor.read(body);
 
 	std::string key, value;
 	for (int i = 0; i < body.kvCount; ++i)
 	{
-		key = readIntLPString(m_file);
-		value = readIntLPString(m_file);
+		key = m_cursor.readIntLPString();
+		value = m_cursor.readIntLPString();
 		entity.keyvalues.emplace_back(key, value);
 	}
 
-	std::int32_t visgroupCount = readInt(m_file);
+	std::int32_t visgroupCount = m_cursor.readInt();
 	for (int i = 0; i < visgroupCount; ++i)
-		readInt(m_file); // visgroup id
+		m_cursor.readInt(); // visgroup id
 
-	std::int32_t brushCount = readInt(m_file);
-	for (int i = 0; i < brushCount; ++i)
-		readBrush(entity);
+	// Brushes of entities that aren't converted are only written back out
+	const bool raw = !needsGeometry(entity);
+
+	std::int32_t brushCount = m_cursor.readInt();
+	entity.brushes.resize(std::max(brushCount, 0));
+	for (std::unique_ptr<Brush>& brush : entity.brushes)
+	{
+		brushSlots.push_back({ &brush, m_cursor.offset(), raw });
+		skipBrush();
+	}
 
 	if (!brushCount && !entity.hasKey("origin"))
 		entity.keyvalues.emplace_back("origin",
@@ -236,62 +230,116 @@ void JmfReader::readEntity()
 		);
 }
 
-void JmfReader::readBrush(Entity& parent)
+void JmfReader::skipBrush()
 {
-	parent.brushes.emplace_back(std::make_unique<JmfBrush>());
-	Brush& brush = *parent.brushes.back();
+	JmfBrushHeader header{};
+	m_cursor.read(header);
+	m_cursor.skip(sizeof(std::int32_t) * std::max(header.visgroupCount, 0));
+
+	std::int32_t faceCount = m_cursor.readInt();
+	for (int i = 0; i < faceCount; ++i)
+	{
+		m_cursor.readInt(); // Editor flags
+		std::int32_t vertexCount = m_cursor.readInt();
+		m_cursor.skip(sizeof(JmfFace) + sizeof(float[3]) + sizeof(float) + sizeof(std::int32_t));
+		m_cursor.skip(sizeof(JmfVertex) * std::max(vertexCount, 0));
+	}
+
+	m_cursor.skip(sizeof(JmfCurve) * std::max(header.curveCount, 0));
+}
+
+std::unique_ptr<Brush> JmfReader::readBrush(BinaryCursor& cursor, bool raw)
+{
+	std::unique_ptr<Brush> brush = std::make_unique<JmfBrush>();
 
 	JmfBrushHeader header{};
-	m_file.read(reinterpret_cast<char*>(&header), sizeof(JmfBrushHeader));
+	cursor.read(header);
 
 	for (int i = 0; i < header.visgroupCount; ++i)
-		readInt(m_file); // visgroup id
+		cursor.readInt(); // visgroup id
 
-	std::int32_t faceCount = readInt(m_file);
-	for (int i = 0; i < faceCount; ++i)
-		brush.faces.push_back(readFace());
+	std::int32_t faceCount = cursor.readInt();
+	if (raw)
+	{
+		brush->rawFaces.reserve(std::max(faceCount, 0));
+		for (int i = 0; i < faceCount; ++i)
+			brush->rawFaces.push_back(readRawFace(cursor));
+	}
+	else
+	{
+		brush->faces.reserve(std::max(faceCount, 0));
+		for (int i = 0; i < faceCount; ++i)
+			brush->faces.push_back(readFace(cursor));
+	}
 
 	for (int i = 0; i < header.curveCount; ++i)
-		readCurve();
+		readCurve(cursor);
+
+	return brush;
 }
 
-void JmfReader::readCurve()
+void JmfReader::readCurve(BinaryCursor& cursor)
 {
 	//JmfCurve curve{};
-	//m_file.read(reinterpret_cast<char*>(&curve), sizeof(JmfCurve));
-	m_file.seekg(sizeof(JmfCurve), std::ios::cur); // Don't read, just skip
+	//cursor.read(curve);
+	cursor.skip(sizeof(JmfCurve)); // Don't read, just skip
 }
 
-Face JmfReader::readFace()
+Face JmfReader::readFace(BinaryCursor& cursor)
 {
 	Face face;
 
-	readInt(m_file); // Editor flags
-	std::int32_t vertexCount = readInt(m_file);
+	cursor.readInt(); // Editor flags
+	std::int32_t vertexCount = cursor.readInt();
+	face.vertices.reserve(std::max(vertexCount, 0));
 
 	JmfFace faceProperties{};
-	m_file.read(reinterpret_cast<char*>(&faceProperties), sizeof(JmfFace));
+	cursor.read(faceProperties);
 	faceProperties.toTexture(face.texture);
 
-	M2PWad3::ImageSize imageInfo = wadHandler.checkTexture(face.texture.name);
-
-	face.texture.width = imageInfo.width;
-	face.texture.height = imageInfo.height;
-
 	float normal[3]{};
-	m_file.read(reinterpret_cast<char*>(&normal), sizeof(normal));
+	cursor.read(normal);
 	face.normal = Vector3{ normal };
 
-	readFloat(m_file); // Distance
-	readInt(m_file); // Aligned axis (0=X, 1=Y, 2=Z, 3=Unaligned)
+	cursor.readFloat(); // Distance
+	cursor.readInt(); // Aligned axis (0=X, 1=Y, 2=Z, 3=Unaligned)
 
 	for (int i = 0; i < vertexCount; ++i)
 	{
 		JmfVertex vertex{};
-		m_file.read(reinterpret_cast<char*>(&vertex), sizeof(JmfVertex));
+		cursor.read(vertex);
 		vertex.uv[1] = -vertex.uv[1];
 		face.vertices.emplace_back(vertex.coords, vertex.uv, face.normal);
 	}
 
 	return face;
 }
+
+RawFace JmfReader::readRawFace(BinaryCursor& cursor)
+{
+	RawFace face;
+
+	cursor.readInt(); // Editor flags
+	std::int32_t vertexCount = cursor.readInt();
+	if (vertexCount < 3)
+		throw std::runtime_error(std::format("Face with {} vertices at offset {}", vertexCount, cursor.offset()));
+
+	JmfFace faceProperties{};
+	cursor.read(faceProperties);
+	faceProperties.toTexture(face.texture);
+
+	cursor.skip(sizeof(float[3])); // Normal
+	cursor.readFloat(); // Distance
+	cursor.readInt(); // Aligned axis (0=X, 1=Y, 2=Z, 3=Unaligned)
+
+	// Only the last three vertices are written back out, last one first
+	cursor.skip(sizeof(JmfVertex) * (vertexCount - 3));
+	for (int i = 2; i >= 0; --i)
+	{
+		JmfVertex vertex{};
+		cursor.read(vertex);
+		face.points[i] = Vector3{ vertex.coords };
+	}
+
+	return face;
+}
@@ -4,6 +4,7 @@
 #include <fstream>
 #include <filesystem>
 #include "entity.h"
+#include "binutils.h"
 
 namespace M2PJMF
 {
@@ -129,12 +130,7 @@ namespace M2PJMF
 	{
 	public:
 		std::string getRaw() const override;
-	};
-
-	class JmfEntity : public M2PEntity::Entity
-	{
-	public:
-		std::string toString() const override;
+		void writeRaw(M2PUtils::BufferedWriter& writer) const override;
 	};
 
 }
@@ -145,12 +141,11 @@ namespace M2PFormat
 	{
 	public:
 		JmfReader(const std::filesystem::path& filepath, const std::filesystem::path& outputDir);
-		~JmfReader();
 	private:
 		int m_version;
 		std::filesystem::path m_filepath;
 		std::filesystem::path m_outputDir;
-		std::ifstream m_file;
+		M2PBinUtils::BinaryCursor m_cursor;
 
 		void parse();
 
@@ -160,9 +155,21 @@ namespace M2PFormat
 		void readCamera();
 		void readPath();
 		void readPathNode();
-		void readEntity();
-		void readBrush(M2PEntity::Entity& parent);
-		void readCurve();
-		M2PEntity::Face readFace();
+		/** Where a brush starts in the file, the entity slot it is decoded into and whether only its raw faces are needed */
+		struct BrushSlot
+		{
+			std::unique_ptr<M2PEntity::Brush>* slot;
+			size_t offset;
+			bool raw;
+		};
+
+		void readEntity(std::vector<BrushSlot>& brushSlots);
+		void skipBrush();
+
+		// Brush decoding runs on several threads, so it only touches the cursor it is given
+		static std::unique_ptr<M2PEntity::Brush> readBrush(M2PBinUtils::BinaryCursor& cursor, bool raw);
+		static void readCurve(M2PBinUtils::BinaryCursor& cursor);
+		static M2PEntity::Face readFace(M2PBinUtils::BinaryCursor& cursor);
+		static M2PEntity::RawFace readRawFace(M2PBinUtils::BinaryCursor& cursor);
 	};
 }
@@ -1,8 +1,12 @@
 #include <string>
-#include <sstream>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <charconv>
 #include "map_format.h"
 #include "logging.h"
-#include "utils.h"
+#include "config.h"
+#include "parallel.h"
 
 
 static inline Logging::Logger& logger = Logging::Logger::getLogger("mapreader");
@@ -13,32 +17,101 @@ using namespace M2PGeo;
 using namespace M2PEntity;
 
 
-MapReader::MapReader(const std::filesystem::path& filepath, const std::filesystem::path& outputDir)
+MapReader::MapReader(const std::filesystem::path& filepath, const std::filesystem::path& outputDir, bool stream)
 {
 	m_filepath = filepath;
 	m_outputDir = outputDir;
-	m_file.open(filepath);
-	if (!m_file.is_open() || !m_file.good())
+	source = std::make_shared<M2PUtils::MappedFile>(filepath);
+	if (!source->isOpen())
 	{
-		m_file.close();
 		logger.error("Could not open file " + filepath.string());
 		exit(EXIT_FAILURE);
 	}
 
+	m_text = source->view();
+	if (stream)
+		return;
+
 	parse();
-	m_file.close();
+
+	buildBrushFaces(m_brushPlanes, static_cast<unsigned int>(M2PConfig::g_config.threads));
+	m_brushPlanes.clear();
+	resolveTextures(true);
 }
-MapReader::~MapReader()
+
+// Splits like repeated std::getline calls, so a trailing delimiter gives no empty last part
+template <size_t N>
+static inline size_t splitLine(std::string_view line, char delimiter, std::array<std::string_view, N>& partsOut)
 {
-	if (m_file.is_open())
-		m_file.close();
+	size_t count = 0;
+	size_t start = 0;
+	while (start < line.size())
+	{
+		size_t end = line.find(delimiter, start);
+		if (end == std::string_view::npos)
+			end = line.size();
+
+		if (count < N)
+			partsOut[count] = line.substr(start, end - start);
+		++count;
+		start = end + 1;
+	}
+	return count;
+}
+
+static inline FP parseFloat(std::string_view token, std::string_view line)
+{
+	// std::stof took a leading plus sign, std::from_chars doesn't
+	if (token.size() > 1 && token[0] == '+' && token[1] != '-')
+		token.remove_prefix(1);
+
+	float value;
+	const auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+	if (error != std::errc{} || end == token.data())
+	{
+		logger.error("Unexpected face data: \"" + std::string(line) + "\"");
+		exit(EXIT_FAILURE);
+	}
+	return value;
+}
+
+bool MapReader::nextLine(std::string_view& lineOut)
+{
+	if (m_offset >= m_text.size())
+		return false;
+
+	size_t end = m_text.find('\n', m_offset);
+	if (end == std::string_view::npos)
+		end = m_text.size();
+
+	lineOut = m_text.substr(m_offset, end - m_offset);
+	m_offset = std::min(end + 1, m_text.size());
+	return true;
+}
+
+Entity* MapReader::readNextEntity()
+{
+	std::string_view line;
+	while (nextLine(line))
+	{
+		if (!line.starts_with('{'))
+			continue;
+
+		entities.emplace_back(std::make_unique<Entity>());
+		readEntity(*entities.back());
+
+		buildBrushFaces(m_brushPlanes, static_cast<unsigned int>(M2PConfig::g_config.threads));
+		m_brushPlanes.clear();
+		resolveTextures(true, entities.size() - 1);
+		return entities.back().get();
+	}
+	return nullptr;
 }
 
 void MapReader::parse()
 {
-	std::string line;
-	line.reserve(1024);
-	while (std::getline(m_file, line))
+	std::string_view line;
+	while (nextLine(line))
 	{
 		if (line.starts_with('{'))
 		{
@@ -51,18 +124,17 @@ void MapReader::parse()
 
 void MapReader::readEntity(Entity &entity)
 {
-	// Reseve .5M for worldspawn, 2048 otherwise
-	entity.raw.reserve((entities.size() == 0) ? static_cast<size_t>(5e5) : 2048);
-	entity.raw += "{\n";
-
-	std::string line, key, value;
-	line.reserve(512);
-	while (std::getline(m_file, line))
+	std::string_view line;
+	std::string stripped;
+	std::array<std::string_view, 4> parts;
+	while (nextLine(line))
 	{
-#ifndef _WIN32
-		M2PUtils::replaceToken(line, "\r", "");
-#endif
-		entity.raw += line + "\n";
+		if (line.find('\r') != std::string_view::npos)
+		{
+			stripped = line;
+			std::erase(stripped, '\r');
+			line = stripped;
+		}
 
 		if (line.starts_with("//"))
 		{
@@ -70,30 +142,20 @@ void MapReader::readEntity(Entity &entity)
 		}
 		else if (line.starts_with('"'))
 		{
-			const std::vector<std::string>& parts = M2PUtils::split(line, '"');
-			if (parts.size() != 4)
+			if (splitLine(line, '"', parts) != 4)
 			{
-				logger.error("Invalid entity property: \"" + line + "\"");
+				logger.error("Invalid entity property: \"" + std::string(line) + "\"");
 				exit(EXIT_FAILURE);
 			}
-			key = parts.at(1);
-			value = parts.at(3);
-			if (key == "classname")
-				entity.classname = value;
-			entity.keyvalues.emplace_back(key, value);
+			if (parts[1] == "classname")
+				entity.classname = parts[3];
+			entity.keyvalues.emplace_back(parts[1], parts[3]);
 		}
 		else if (line.starts_with('{'))
 		{
-			bool valid = true;
-
-			entity.brushes.emplace_back(std::make_unique<Brush>());
-			Brush& brush = *entity.brushes.back();
-			readBrush(brush, line, valid);
-
-			if (valid)
-				entity.raw += brush.raw;
-			else
-				entity.brushes.pop_back();
+			auto brush = std::make_unique<MapBrush>(source);
+			readBrush(*brush);
+			entity.brushes.push_back(std::move(brush));
 		}
 		else if (line.starts_with('}'))
 		{
@@ -101,84 +163,155 @@ void MapReader::readEntity(Entity &entity)
 		}
 		else
 		{
-			logger.error("Unexpected entity data: \"" + line + "\"");
+			logger.error("Unexpected entity data: \"" + std::string(line) + "\"");
 			exit(EXIT_FAILURE);
 		}
 	}
+
+	if (!needsGeometry(entity))
+		return;
+
+	std::erase_if(entity.brushes, [this](const std::unique_ptr<Brush>& brush) {
+		return !decodeBrush(static_cast<MapBrush&>(*brush));
+	});
 }
 
 
-void MapReader::readBrush(Brush& brush, std::string& line, bool &outValid)
+void MapReader::readBrush(MapBrush& brush)
 {
-	brush.raw.reserve(512);
-	brush.raw = "";
-	std::vector<Plane> planes;
-
-	while (std::getline(m_file, line))
+	std::string_view line;
+	while (nextLine(line))
 	{
 		if (line.starts_with("//"))
 			continue;
 
 		if (line.starts_with('('))
 		{
-			if (!outValid)
-				continue;
+			const size_t lineOffset = static_cast<size_t>(line.data() - m_text.data());
+			brush.addRawLine(lineOffset, m_offset - lineOffset);
+		}
+		else if (line.starts_with('}'))
+		{
+			break;
+		}
+		else
+		{
+			logger.error("Unexpected face data: \"" + std::string(line) + "\"");
+			exit(EXIT_FAILURE);
+		}
+	}
+}
 
-			brush.raw += line + "\n";
 
-			const std::vector<std::string>& parts = M2PUtils::split(line, ' ');
-			if (parts.size() != 31)
+bool MapReader::decodeBrush(MapBrush& brush)
+{
+	std::vector<Plane> planes;
+	std::array<std::string_view, 31> parts;
+
+	for (const MapBrush::TextRange& range : brush.rawRanges())
+	{
+		std::string_view lines = m_text.substr(range.offset, range.length);
+		while (!lines.empty())
+		{
+			const size_t end = std::min(lines.find('\n'), lines.size());
+			const std::string_view line = lines.substr(0, end);
+			lines.remove_prefix(std::min(end + 1, lines.size()));
+
+			if (splitLine(line, ' ', parts) != 31)
 			{
-				logger.error("Unexpected face data: \"" + line + "\"");
+				logger.error("Unexpected face data: \"" + std::string(line) + "\"");
 				exit(EXIT_FAILURE);
 			}
 
 			Vector3 planePoints[3] = {
-				Vector3{ std::stof(parts[1]), std::stof(parts[2]), std::stof(parts[3]) },
-				Vector3{ std::stof(parts[6]), std::stof(parts[7]), std::stof(parts[8]) },
-				Vector3{ std::stof(parts[11]), std::stof(parts[12]), std::stof(parts[13]) }
+				Vector3{ parseFloat(parts[1], line), parseFloat(parts[2], line), parseFloat(parts[3], line) },
+				Vector3{ parseFloat(parts[6], line), parseFloat(parts[7], line), parseFloat(parts[8], line) },
+				Vector3{ parseFloat(parts[11], line), parseFloat(parts[12], line), parseFloat(parts[13], line) }
 			};
-			std::string textureName = parts[15];
-
-
-			M2PWad3::ImageSize imageInfo = wadHandler.checkTexture(textureName);
-
 			Texture texture{
-				.name = textureName,
-				.shiftx = std::stof(parts[20]),
-				.shifty = std::stof(parts[26]),
-				.angle = std::stof(parts[28]),
-				.scalex = std::stof(parts[29]),
-				.scaley = std::stof(parts[30]),
-				.width = imageInfo.width,
-				.height = imageInfo.height,
-				.rightaxis = { std::stof(parts[17]), std::stof(parts[18]), std::stof(parts[19]) },
-				.downaxis = { std::stof(parts[23]), std::stof(parts[24]), std::stof(parts[25]) }
+				.name = std::string(parts[15]),
+				.shiftx = parseFloat(parts[20], line),
+				.shifty = parseFloat(parts[26], line),
+				.angle = parseFloat(parts[28], line),
+				.scalex = parseFloat(parts[29], line),
+				.scaley = parseFloat(parts[30], line),
+				.rightaxis = { parseFloat(parts[17], line), parseFloat(parts[18], line), parseFloat(parts[19], line) },
+				.downaxis = { parseFloat(parts[23], line), parseFloat(parts[24], line), parseFloat(parts[25], line) }
 			};
 
 			if (M2PGeo::segmentsCross(planePoints) == Vector3::zero())
 			{
 				logger.warning("Plane points may not form a line. Near " +
 					std::format("({} {} {})", parts[1], parts[2], parts[3]));
-				outValid = false;
-				continue;
+				return false;
 			}
 
 			planes.emplace_back(planePoints, texture);
 		}
-		else if (line.starts_with('}'))
-		{
-			break;
-		}
-		else
+	}
+
+	if (!planes.empty())
+		m_brushPlanes.push_back({ &brush, std::move(planes) });
+	return true;
+}
+
+
+void MapBrush::addRawLine(size_t offset, size_t length)
+{
+	// Consecutive lines share one range
+	if (!m_rawRanges.empty() && m_rawRanges.back().offset + m_rawRanges.back().length == offset)
+		m_rawRanges.back().length += length;
+	else
+		m_rawRanges.push_back({ offset, length });
+}
+
+std::string MapBrush::getRaw() const
+{
+	size_t size = 1;
+	for (const TextRange& range : m_rawRanges)
+		size += range.length;
+
+	std::string raw;
+	raw.reserve(size);
+	for (const TextRange& range : m_rawRanges)
+		raw += m_source->view(range.offset, range.length);
+
+	// The last line of a file may lack its line break
+	if (!raw.empty() && raw.back() != '\n')
+		raw += '\n';
+
+#ifdef _WIN32
+	// Line breaks are written back in text mode
+	std::erase(raw, '\r');
+#endif
+	return raw;
+}
+
+void MapBrush::writeRaw(M2PUtils::BufferedWriter& writer) const
+{
+	writer.write("{\n");
+
+	for (const TextRange& range : m_rawRanges)
+	{
+		std::string_view text = m_source->view(range.offset, range.length);
+#ifdef _WIN32
+		// Line breaks are written back in text mode
+		for (size_t start = 0; start < text.size();)
 		{
-			logger.error("Unexpected face data: \"" + line + "\"");
-			exit(EXIT_FAILURE);
+			size_t end = std::min(text.find('\r', start), text.size());
+			writer.write(text.substr(start, end - start));
+			start = end + 1;
 		}
+#else
+		writer.write(text);
+#endif
 	}
 
-	if (outValid && !planes.empty())
-		planesToFaces(planes, brush.faces);
+	// The last line of a file may lack its line break
+	if (!m_rawRanges.empty() && !m_source->view(m_rawRanges.back().offset, m_rawRanges.back().length).ends_with('\n'))
+		writer.write('\n');
+
+	writer.write("}\n");
 }
 
 
@@ -220,53 +353,160 @@ static inline void addPointUnique(std::vector<Vertex>& vertices, const Vector3 &
 	vertices.emplace_back(point);
 }
 
-void M2PMAP::planesToFaces(const std::vector<Plane>& planes, std::vector<Face> &facesOut)
+// Clipping runs in double precision, a float polygon this large would lose the brush's detail
+struct ClipPoint
 {
-	size_t numPlanes = planes.size();
-	facesOut.assign(numPlanes, {});
+	double x, y, z;
+};
 
-	for (int i = 0; i < numPlanes - 2; ++i)
+static inline constexpr double c_CLIP_HALF_SIZE = 1 << 20;
+static inline constexpr double c_CLIP_EPSILON = 1e-6;
+static inline constexpr double c_CANDIDATE_PLANE_DISTANCE = 4 * c_EPSILON_ONPLANE;
+
+static inline double planeDistance(const Plane& plane, const ClipPoint& point)
+{
+	const Vector3 normal = plane.normal();
+	return normal.x * point.x + normal.y * point.y + normal.z * point.z - plane.distance();
+}
+
+static std::vector<ClipPoint> baseWinding(const Plane& plane)
+{
+	const Vector3 normal = plane.normal();
+	const Vector3 axis = (std::abs(normal.x) < .5f) ? Vector3{ 1, 0, 0 } : Vector3{ 0, 1, 0 };
+	const Vector3 u = normal.cross(axis).normalised();
+	const Vector3 v = normal.cross(u);
+	const Vector3 origin = normal * plane.distance();
+
+	std::vector<ClipPoint> winding;
+	for (const auto& [su, sv] : { std::pair{ -1., -1. }, { 1., -1. }, { 1., 1. }, { -1., 1. } })
 	{
-		for (int j = i; j < numPlanes - 1; ++j)
-		{
-			for (int k = j; k < numPlanes; ++k)
-			{
-				if (i == j && i == k)
-					continue;
+		winding.push_back({
+			origin.x + (su * u.x + sv * v.x) * c_CLIP_HALF_SIZE,
+			origin.y + (su * u.y + sv * v.y) * c_CLIP_HALF_SIZE,
+			origin.z + (su * u.z + sv * v.z) * c_CLIP_HALF_SIZE,
+		});
+	}
+	return winding;
+}
 
-				Vector3 intersection;
+// Keeps the part of the winding behind the plane
+static void clipWinding(std::vector<ClipPoint>& winding, const Plane& plane, std::vector<ClipPoint>& scratch)
+{
+	scratch.clear();
+	const size_t count = winding.size();
+	for (size_t i = 0; i < count; ++i)
+	{
+		const ClipPoint& a = winding[i];
+		const ClipPoint& b = winding[(i + 1) % count];
+		const double da = planeDistance(plane, a);
+		const double db = planeDistance(plane, b);
 
-				if (!intersection3Planes(planes[i], planes[j], planes[k], intersection))
-					continue;
+		if (da <= c_CLIP_EPSILON)
+			scratch.push_back(a);
 
-				if (isPointOutsidePlanes(planes, intersection))
-					continue;
+		if ((da < -c_CLIP_EPSILON && db > c_CLIP_EPSILON) || (da > c_CLIP_EPSILON && db < -c_CLIP_EPSILON))
+		{
+			const double t = da / (da - db);
+			scratch.push_back({ a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t });
+		}
+	}
+	winding.swap(scratch);
+}
 
-				addPointUnique(facesOut[i].vertices, intersection);
-				addPointUnique(facesOut[j].vertices, intersection);
-				addPointUnique(facesOut[k].vertices, intersection);
+/**
+ * Finds the plane triples that can meet at a corner of the brush.
+ * Each face is clipped from a huge quad down to its polygon, and every plane passing
+ * near one of the polygon's corners is a candidate for the triples meeting there.
+ */
+static std::vector<std::array<size_t, 3>> candidateTriples(const std::vector<Plane>& planes)
+{
+	const size_t numPlanes = planes.size();
+	std::vector<std::array<size_t, 3>> triples;
+	std::vector<ClipPoint> winding, scratch;
+	std::vector<size_t> nearPlanes;
 
-				facesOut[i].texture = planes[i].texture();
-				facesOut[j].texture = planes[j].texture();
-				facesOut[k].texture = planes[k].texture();
+	for (size_t i = 0; i < numPlanes; ++i)
+	{
+		winding = baseWinding(planes[i]);
+		for (size_t j = 0; j < numPlanes && !winding.empty(); ++j)
+			if (j != i)
+				clipWinding(winding, planes[j], scratch);
 
-				facesOut[i].normal = planes[i].normal();
-				facesOut[j].normal = planes[j].normal();
-				facesOut[k].normal = planes[k].normal();
-			}
+		for (const ClipPoint& corner : winding)
+		{
+			nearPlanes.clear();
+			for (size_t j = 0; j < numPlanes; ++j)
+				if (std::abs(planeDistance(planes[j], corner)) < c_CANDIDATE_PLANE_DISTANCE)
+					nearPlanes.push_back(j);
+
+			// Only keep triples including this face, the other faces add their own
+			for (size_t a = 0; a < nearPlanes.size(); ++a)
+				for (size_t b = a + 1; b < nearPlanes.size(); ++b)
+					for (size_t c = b + 1; c < nearPlanes.size(); ++c)
+						if (nearPlanes[a] == i || nearPlanes[b] == i || nearPlanes[c] == i)
+							triples.push_back({ nearPlanes[a], nearPlanes[b], nearPlanes[c] });
 		}
 	}
 
-	if (std::erase_if(facesOut, [](Face face) { return face.vertices.size() < 3; }))
-		logger.warning("Faces with fewer than 3 vertices skipped");
+	std::sort(triples.begin(), triples.end());
+	triples.erase(std::unique(triples.begin(), triples.end()), triples.end());
+	return triples;
+}
+
+size_t M2PMAP::planesToFaces(const std::vector<Plane>& planes, std::vector<Face> &facesOut)
+{
+	size_t numPlanes = planes.size();
+	facesOut.assign(numPlanes, {});
+
+	// Same acceptance test and lexicographic order as trying every triple, so vertices come out identical
+	for (const auto& [i, j, k] : candidateTriples(planes))
+	{
+		Vector3 intersection;
+
+		if (!intersection3Planes(planes[i], planes[j], planes[k], intersection))
+			continue;
+
+		if (isPointOutsidePlanes(planes, intersection))
+			continue;
+
+		addPointUnique(facesOut[i].vertices, intersection);
+		addPointUnique(facesOut[j].vertices, intersection);
+		addPointUnique(facesOut[k].vertices, intersection);
+	}
+
+	for (size_t i = 0; i < numPlanes; ++i)
+	{
+		if (facesOut[i].vertices.empty())
+			continue;
+
+		facesOut[i].texture = planes[i].texture();
+		facesOut[i].normal = planes[i].normal();
+	}
+
+	const size_t skipped = std::erase_if(facesOut, [](const Face& face) { return face.vertices.size() < 3; });
 
 	for (Face& face : facesOut)
 	{
 		sortVertices(face.vertices, face.normal);
 		for (M2PGeo::Vertex &vertex : face.vertices)
-		{
-			vertex.uv = face.texture.uvForPoint(vertex);
 			vertex.normal = face.normal;
-		}
 	}
+
+	return skipped;
+}
+
+static inline constexpr size_t c_BRUSHES_PER_TASK = 16;
+
+void M2PMAP::buildBrushFaces(std::vector<BrushPlanes>& brushes, unsigned int threads)
+{
+	std::vector<size_t> skipped(brushes.size(), 0);
+
+	M2PUtils::parallelFor(brushes.size(), c_BRUSHES_PER_TASK, threads, [&](size_t i)
+	{
+		skipped[i] = planesToFaces(brushes[i].planes, brushes[i].brush->faces);
+	});
+
+	for (size_t count : skipped)
+		if (count)
+			logger.warning("Faces with fewer than 3 vertices skipped");
 }
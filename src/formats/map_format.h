@@ -1,10 +1,12 @@
 #pragma once
 
-#include <fstream>
 #include <filesystem>
 #include <vector>
+#include <memory>
+#include <string_view>
 #include "geometry.h"
 #include "entity.h"
+#include "mapped_file.h"
 
 
 namespace M2PMAP
@@ -15,7 +17,55 @@ namespace M2PMAP
 		const M2PGeo::HessianPlane& p3,
 		M2PGeo::Vector3& intersectionOut);
 
-	void planesToFaces(const std::vector<M2PGeo::Plane>& planes, std::vector<M2PEntity::Face>& faces);
+	/**
+	 * @return Number of faces skipped for having fewer than 3 vertices
+	 */
+	size_t planesToFaces(const std::vector<M2PGeo::Plane>& planes, std::vector<M2PEntity::Face>& faces);
+
+	/**
+	 * Planes read for a brush whose faces are yet to be built
+	 */
+	struct BrushPlanes
+	{
+		M2PEntity::Brush* brush;
+		std::vector<M2PGeo::Plane> planes;
+	};
+
+	/**
+	 * Builds the faces of every brush with planesToFaces, splitting the brushes between worker threads.
+	 * Each brush only writes its own faces, so the result is the same for any thread count.
+	 * Warnings are logged afterwards in brush order.
+	 * @param threads Number of threads to use, 0 uses all hardware threads
+	 */
+	void buildBrushFaces(std::vector<BrushPlanes>& brushes, unsigned int threads = 1);
+
+	/**
+	 * Brush keeping its face lines as offsets into the mapped MAP file
+	 */
+	class MapBrush : public M2PEntity::Brush
+	{
+	public:
+		MapBrush(std::shared_ptr<const M2PUtils::MappedFile> source) : m_source(std::move(source)) {}
+
+		/**
+		 * @param offset Start of the line in the mapping
+		 * @param length Length of the line including its line break, if any
+		 */
+		struct TextRange
+		{
+			size_t offset;
+			size_t length;
+		};
+
+		void addRawLine(size_t offset, size_t length);
+		const std::vector<TextRange>& rawRanges() const { return m_rawRanges; }
+		std::string getRaw() const override;
+		/** Splices the face lines straight from the mapping into the writer */
+		void writeRaw(M2PUtils::BufferedWriter& writer) const override;
+	private:
+		std::shared_ptr<const M2PUtils::MappedFile> m_source;
+		std::vector<TextRange> m_rawRanges;
+	};
 }
 
 namespace M2PFormat
@@ -23,15 +73,32 @@ namespace M2PFormat
 	class MapReader : public M2PEntity::BaseReader
 	{
 	public:
-		MapReader(const std::filesystem::path &filepath, const std::filesystem::path &outputDir);
-		~MapReader();
+		/**
+		 * @param stream Leave the entities to be read one at a time with readNextEntity()
+		 */
+		MapReader(const std::filesystem::path &filepath, const std::filesystem::path &outputDir, bool stream = false);
+
+		/**
+		 * Reads the next entity and builds its brush faces
+		 * @return The entity, now last in entities, or nullptr at the end of the file
+		 */
+		M2PEntity::Entity* readNextEntity();
 	private:
 		std::filesystem::path m_filepath;
 		std::filesystem::path m_outputDir;
-		std::ifstream m_file;
+		std::string_view m_text;
+		size_t m_offset = 0;
+		std::vector<M2PMAP::BrushPlanes> m_brushPlanes;
 
+		bool nextLine(std::string_view& lineOut);
 		void parse();
 		void readEntity(M2PEntity::Entity &entity);
-		void readBrush(M2PEntity::Brush &brush, std::string& line, bool &outValid);
+		void readBrush(M2PMAP::MapBrush &brush);
+
+		/**
+		 * Parses the planes of a brush's raw face lines and queues them for buildBrushFaces
+		 * @return Whether the brush is valid
+		 */
+		bool decodeBrush(M2PMAP::MapBrush &brush);
 	};
 }
@@ -1,7 +1,13 @@
 #include <string>
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
 #include "obj_format.h"
 #include "logging.h"
 #include "utils.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "config.h"
 
 
 static inline Logging::Logger& logger = Logging::Logger::getLogger("objreader");
@@ -10,196 +16,262 @@ using namespace M2PFormat;
 using namespace M2POBJ;
 using namespace M2PGeo;
 using namespace M2PEntity;
+using M2PConfig::g_config;
+
+
+static inline constexpr size_t c_CHUNK_SIZE = 1 << 20;
+static inline constexpr size_t c_FACES_PER_TASK = 256;
 
 
 ObjReader::ObjReader(const std::filesystem::path& filepath, const std::filesystem::path& outputDir)
 {
 	m_filepath = filepath;
 	m_outputDir = outputDir;
-	m_file.open(filepath);
-	if (!m_file.is_open() || !m_file.good())
+	M2PUtils::MappedFile file{ filepath };
+	if (!file.isOpen())
 	{
-		m_file.close();
 		logger.error("Could not open file " + filepath.string());
 		exit(EXIT_FAILURE);
 	}
 
-	parse();
-	m_file.close();
+	parse(file.view());
+	resolveTextures(false);
 }
-ObjReader::~ObjReader()
+
+// Lines are returned without their line break, or the '\r' before it
+static inline bool nextLine(std::string_view text, size_t& offset, std::string_view& lineOut)
 {
-	if (m_file.is_open())
-		m_file.close();
+	if (offset >= text.size())
+		return false;
+
+	size_t end = text.find('\n', offset);
+	if (end == std::string_view::npos)
+		end = text.size();
+
+	lineOut = text.substr(offset, end - offset);
+	if (lineOut.ends_with('\r'))
+		lineOut.remove_suffix(1);
+	offset = end + 1;
+	return true;
 }
 
-void ObjReader::parse()
+static inline void skipSpaces(const char*& it, const char* end)
 {
-	std::string line;
-	line.reserve(1024);
-	std::getline(m_file, line);
-
-	while (!line.empty())
-	{
-		if (line.starts_with('#'))
-		{
-			std::getline(m_file, line);
-			continue;
-		}
-
-		// Parse coordinates
-		if (line.starts_with(c_VERTEX_PREFIX))
-		{
-			line.replace(0, c_VERTEX_PREFIX.length(), "");
-			m_vertexCoords.push_back(readCoordinate(line));
-			std::getline(m_file, line);
-			continue;
-		}
-		if (line.starts_with(c_UV_PREFIX))
-		{
-			line.replace(0, c_UV_PREFIX.length(), "");
-			Vector3 coord = readCoordinate(line);
-			m_uvCoords.emplace_back(coord.x, coord.y);
-			std::getline(m_file, line);
-			continue;
-		}
-		if (line.starts_with(c_NORMAL_PREFIX))
-		{
-			line.replace(0, c_NORMAL_PREFIX.length(), "");
-			m_normalCoords.push_back(readCoordinate(line));
-			std::getline(m_file, line);
-			continue;
-		}
-
-		// Parse entities
-		if (line.starts_with(c_OBJECT_PREFIX))
-		{
-			line.replace(0, c_OBJECT_PREFIX.length(), "");
-			readEntity(line);
-			continue;
-		}
-
-		std::getline(m_file, line);
-	}
+	while (it < end && *it == ' ')
+		++it;
 }
 
-Vector3 ObjReader::readCoordinate(const std::string& line)
+/** Reads the three numbers of a v, vt or vn line */
+static inline Vector3 readCoordinate(std::string_view values, std::string_view line)
 {
-	const std::vector<std::string>& parts = M2PUtils::split(line, ' ');
-	if (parts.size() != 3)
+	FP coords[3]{};
+	const char* it = values.data();
+	const char* end = values.data() + values.size();
+	for (FP& coord : coords)
 	{
-		logger.error("Invalid vertex data: \"" + line + "\"");
-		exit(EXIT_FAILURE);
+		skipSpaces(it, end);
+		const auto [next, error] = std::from_chars(it, end, coord);
+		if (error != std::errc{})
+			throw std::runtime_error("Invalid vertex data: \"" + std::string(line) + "\"");
+		it = next;
 	}
+	skipSpaces(it, end);
+	if (it != end)
+		throw std::runtime_error("Invalid vertex data: \"" + std::string(line) + "\"");
 
-	return { std::stof(parts[0]), std::stof(parts[1]), std::stof(parts[2]) };
+	return { coords[0], coords[1], coords[2] };
 }
 
-void ObjReader::readEntity(std::string& line)
+void ObjReader::parse(std::string_view text)
 {
-	entities.emplace_back(std::make_unique<Entity>());
-	Entity& entity = *entities.back();
+	readCoordinates(text);
 
-	size_t start = line.find('(') + 1;
-	size_t end = line.find(')');
-	entity.classname = line.substr(start, end - start);
-	std::getline(m_file, line);
+	std::vector<FaceSlot> faceSlots;
+	readStructure(text, faceSlots);
 
-	while (true)
+	// Faces only read the finished coordinate arrays and write their own slot
+	M2PUtils::parallelFor(faceSlots.size(), c_FACES_PER_TASK, static_cast<unsigned int>(g_config.threads), [&](size_t i)
 	{
-		if (line.starts_with('#'))
-		{
-			std::getline(m_file, line);
-			continue;
-		}
-
-		if (line.starts_with(c_SMOOTH_PREFIX))
-		{
-			line.replace(0, c_SMOOTH_PREFIX.length(), "");
-			std::getline(m_file, line);
-			continue;
-		}
-
-		if (line.starts_with(c_GROUP_PREFIX))
-		{
-			readBrush(entity, line);
-			continue;
-		}
-
-		break;
-	}
+		const FaceSlot& slot = faceSlots[i];
+		readFace(slot.brush->faces[slot.index], slot.line);
+	});
 }
 
-void ObjReader::readBrush(M2PEntity::Entity& entity, std::string& line)
+void ObjReader::readCoordinates(std::string_view text)
 {
-	entity.brushes.emplace_back(std::make_unique<Brush>());
-	Brush& brush = *entity.brushes.back();
-	std::getline(m_file, line);
+	// Chunks end on line breaks, so no line is split between two of them
+	std::vector<std::string_view> chunks;
+	for (size_t start = 0; start < text.size();)
+	{
+		size_t end = text.find('\n', std::min(start + c_CHUNK_SIZE, text.size()));
+		end = (end == std::string_view::npos) ? text.size() : end + 1;
+		chunks.push_back(text.substr(start, end - start));
+		start = end;
+	}
 
-	while (true)
+	struct ChunkCoordinates
 	{
-		if (line.starts_with('#'))
-		{
-			std::getline(m_file, line);
-			continue;
-		}
+		std::vector<Vector3> vertices;
+		std::vector<Vector2> uvs;
+		std::vector<Vector3> normals;
+	};
+	std::vector<ChunkCoordinates> results(chunks.size());
 
-		if (line.starts_with(c_USEMTL_PREFIX))
+	M2PUtils::parallelFor(chunks.size(), 1, static_cast<unsigned int>(g_config.threads), [&](size_t i)
+	{
+		ChunkCoordinates& result = results[i];
+		size_t offset = 0;
+		std::string_view line;
+		while (nextLine(chunks[i], offset, line))
 		{
-			line.replace(0, c_USEMTL_PREFIX.length(), "");
-			readFace(brush, line);
-			continue;
+			if (line.starts_with(c_VERTEX_PREFIX))
+			{
+				result.vertices.push_back(readCoordinate(line.substr(c_VERTEX_PREFIX.size()), line));
+			}
+			else if (line.starts_with(c_UV_PREFIX))
+			{
+				Vector3 coord = readCoordinate(line.substr(c_UV_PREFIX.size()), line);
+				result.uvs.emplace_back(coord.x, coord.y);
+			}
+			else if (line.starts_with(c_NORMAL_PREFIX))
+			{
+				result.normals.push_back(readCoordinate(line.substr(c_NORMAL_PREFIX.size()), line));
+			}
 		}
+	});
 
-		break;
+	size_t vertexCount = 0, uvCount = 0, normalCount = 0;
+	for (const ChunkCoordinates& result : results)
+	{
+		vertexCount += result.vertices.size();
+		uvCount += result.uvs.size();
+		normalCount += result.normals.size();
+	}
+	m_vertexCoords.reserve(vertexCount);
+	m_uvCoords.reserve(uvCount);
+	m_normalCoords.reserve(normalCount);
+	for (const ChunkCoordinates& result : results)
+	{
+		M2PUtils::extendVector(m_vertexCoords, result.vertices);
+		M2PUtils::extendVector(m_uvCoords, result.uvs);
+		M2PUtils::extendVector(m_normalCoords, result.normals);
 	}
 }
 
-void ObjReader::readFace(M2PEntity::Brush &brush, std::string &line)
+void ObjReader::readStructure(std::string_view text, std::vector<FaceSlot>& faceSlots)
 {
-	std::string textureName = line;
-	wadHandler.checkTexture(textureName);
-	std::getline(m_file, line);
-
-	while (true)
+	// A line that doesn't belong to the current block ends it and is left to the block around it,
+	// so coordinate lines end every block, and o lines start a new entity from any of them
+	enum class Block { FILE, OBJECT, GROUP, MATERIAL };
+	Block block = Block::FILE;
+	Entity* entity = nullptr;
+	Brush* brush = nullptr;
+	std::string_view textureName;
+
+	size_t offset = 0;
+	std::string_view line;
+	while (nextLine(text, offset, line))
 	{
-		if (line.starts_with('#'))
-		{
-			std::getline(m_file, line);
+		if (line.empty() || line.starts_with('#'))
 			continue;
-		}
 
-		if (line.starts_with(c_FACE_PREFIX))
+		if (block == Block::MATERIAL)
 		{
-			Face face;
-			face.texture.name = textureName;
-
-			line.replace(0, c_FACE_PREFIX.length(), "");
-			std::vector<std::string> parts = M2PUtils::split(line, ' ');
+			if (line.starts_with(c_FACE_PREFIX))
+			{
+				brush->faces.emplace_back().texture.name = textureName;
+				faceSlots.push_back({ brush, brush->faces.size() - 1, line });
+				continue;
+			}
+			block = Block::GROUP;
+		}
 
-			for (const std::string& part : parts)
+		if (block == Block::GROUP)
+		{
+			if (line.starts_with(c_USEMTL_PREFIX))
 			{
-				std::vector<std::string> pointParts = M2PUtils::split(part, '/');
-				int indexV = std::stoi(pointParts[0]) - 1;
-				int indexT = std::stoi(pointParts[1]) - 1;
-				int indexN = std::stoi(pointParts[2]) - 1;
+				textureName = line.substr(c_USEMTL_PREFIX.size());
+				block = Block::MATERIAL;
+				continue;
+			}
+			block = Block::OBJECT;
+		}
 
-				Vertex vertex{ m_vertexCoords[indexV] };
-				vertex.uv = m_uvCoords[indexT];
-				vertex.normal = m_normalCoords[indexN];
+		if (block == Block::OBJECT)
+		{
+			if (line.starts_with(c_SMOOTH_PREFIX))
+				continue;
 
-				face.vertices.push_back(vertex);
+			if (line.starts_with(c_GROUP_PREFIX))
+			{
+				entity->brushes.emplace_back(std::make_unique<Brush>());
+				brush = entity->brushes.back().get();
+				block = Block::GROUP;
+				continue;
 			}
+			block = Block::FILE;
+		}
+
+		if (line.starts_with(c_OBJECT_PREFIX))
+		{
+			entities.emplace_back(std::make_unique<Entity>());
+			entity = entities.back().get();
+
+			std::string_view name = line.substr(c_OBJECT_PREFIX.size());
+			size_t start = name.find('(') + 1;
+			size_t end = name.find(')');
+			entity->classname = name.substr(start, end - start);
+			block = Block::OBJECT;
+		}
+	}
+}
 
-			Vector3 planePoints[3] = { face.vertices[0].coord(), face.vertices[1].coord(), face.vertices[2].coord() };
-			face.normal = M2PGeo::planeNormal(planePoints);
+void ObjReader::readFace(Face& face, std::string_view line) const
+{
+	auto invalid = [&line]() { return std::runtime_error("Invalid face data: \"" + std::string(line) + "\""); };
 
-			brush.faces.push_back(face);
+	const char* it = line.data() + c_FACE_PREFIX.size();
+	const char* end = line.data() + line.size();
+	skipSpaces(it, end);
 
-			std::getline(m_file, line);
-			continue;
+	while (it < end)
+	{
+		// Each point is vertex/uv/normal, with 1-based indices
+		int indices[3]{};
+		for (int i = 0; i < 3; ++i)
+		{
+			if (i > 0)
+			{
+				if (it == end || *it != '/')
+					throw invalid();
+				++it;
+			}
+			const auto [next, error] = std::from_chars(it, end, indices[i]);
+			if (error != std::errc{})
+				throw invalid();
+			it = next;
 		}
 
-		break;
+		auto inRange = [](int index, size_t count) { return index >= 1 && static_cast<size_t>(index) <= count; };
+		if (!inRange(indices[0], m_vertexCoords.size())
+			|| !inRange(indices[1], m_uvCoords.size())
+			|| !inRange(indices[2], m_normalCoords.size()))
+			throw std::runtime_error("Face index out of range: \"" + std::string(line) + "\"");
+
+		Vertex vertex{ m_vertexCoords[indices[0] - 1] };
+		vertex.uv = m_uvCoords[indices[1] - 1];
+		vertex.normal = m_normalCoords[indices[2] - 1];
+		face.vertices.push_back(vertex);
+		face.coordIndices.push_back(static_cast<unsigned int>(indices[0] - 1));
+
+		if (it < end && *it != ' ')
+			throw invalid();
+		skipSpaces(it, end);
 	}
+
+	if (face.vertices.size() < 3)
+		throw invalid();
+
+	Vector3 planePoints[3] = { face.vertices[0].coord(), face.vertices[1].coord(), face.vertices[2].coord() };
+	face.normal = M2PGeo::planeNormal(planePoints);
 }
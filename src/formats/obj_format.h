@@ -1,7 +1,7 @@
 #pragma once
 
 #include <vector>
-#include <fstream>
+#include <string_view>
 #include <filesystem>
 #include "entity.h"
 #include "geometry.h"
@@ -30,21 +30,27 @@ namespace M2PFormat
 	{
 	public:
 		ObjReader(const std::filesystem::path& filepath, const std::filesystem::path& outputDir);
-		~ObjReader();
 	private:
 		std::filesystem::path m_filepath;
 		std::filesystem::path m_outputDir;
-		std::ifstream m_file;
 		std::vector<M2PGeo::Vector3> m_vertexCoords;
 		std::vector<M2PGeo::Vector2> m_uvCoords;
 		std::vector<M2PGeo::Vector3> m_normalCoords;
 
-		void parse();
-
-		M2PGeo::Vector3 readCoordinate(const std::string &line);
-
-		void readEntity(std::string &line);
-		void readBrush(M2PEntity::Entity &entity, std::string &line);
-		void readFace(M2PEntity::Brush &brush, std::string &line);
+		/** An f line and the face of a brush it is decoded into */
+		struct FaceSlot
+		{
+			M2PEntity::Brush* brush;
+			size_t index;
+			std::string_view line;
+		};
+
+		void parse(std::string_view text);
+
+		/** Reads every v, vt and vn line, in chunks on the configured threads */
+		void readCoordinates(std::string_view text);
+		/** Builds the entities, brushes and textured faces from the o, g and usemtl lines */
+		void readStructure(std::string_view text, std::vector<FaceSlot>& faceSlots);
+		void readFace(M2PEntity::Face& face, std::string_view line) const;
 	};
 }
@@ -7,6 +7,7 @@
 #include "utils.h"
 #include "binutils.h"
 #include "export.h"
+#include "parallel.h"
 
 static inline Logging::Logger& logger = Logging::Logger::getLogger("olreader");
 
@@ -20,29 +21,25 @@ using namespace M2PBinUtils;
 
 
 OlReader::OlReader(const std::filesystem::path& filepath, const std::filesystem::path& outputDir)
+	: m_file(filepath)
 {
 	m_filepath = filepath;
 	m_outputDir = outputDir;
-	m_file.open(filepath, std::ios::binary);
-	if (!m_file.is_open() || !m_file.good())
+	if (!m_file.isOpen())
 	{
-		m_file.close();
 		logger.error("Could not open file " + filepath.string());
 		exit(EXIT_FAILURE);
 	}
 
 	parse();
 }
-OlReader::~OlReader()
-{
-	if (m_file.is_open())
-		m_file.close();
-}
 
 void OlReader::parse()
 {
+	BinaryCursor cursor{ m_file.view() };
+
 	PrefabLibHeader header{};
-	m_file.read(reinterpret_cast<char*>(&header), sizeof(PrefabLibHeader));
+	cursor.read(header);
 
 	if (abs(header.version - 0.1) > 0.01)
 	{
@@ -52,38 +49,60 @@ void OlReader::parse()
 
 	logger.info(std::format("Reading prefab library with {} prefabs", header.numEntries));
 
+	cursor.seek(header.dirOffset);
 	m_entries.reserve(header.numEntries);
 	for (unsigned int i = 0; i < header.numEntries; ++i)
-	{
-		PrefabHeader prefabHeader{};
-		m_file.seekg(header.dirOffset + (i * sizeof(PrefabHeader)), std::ios::beg);
-
-		m_file.read(reinterpret_cast<char*>(&prefabHeader), sizeof(PrefabHeader));
-		m_entries.push_back(prefabHeader);
-	}
+		m_entries.push_back(cursor.read<PrefabHeader>());
 }
 
 int OlReader::process()
 {
 	int res = 0;
+	const size_t numEntries = m_entries.size();
+	const unsigned int threads = static_cast<unsigned int>(g_config.threads);
 
 	std::vector<std::filesystem::path> successes;
-	successes.reserve(m_entries.size() * 10);
+	successes.reserve(numEntries * 10);
 
+	std::vector<std::string> filenames;
+	filenames.reserve(numEntries);
 	for (const PrefabHeader& entry : m_entries)
+		filenames.push_back(M2PUtils::slugify(entry.name));
+
+	// Every prefab is parsed straight out of its slice of the library
+	std::vector<std::unique_ptr<RmfReader>> readers(numEntries);
+	M2PUtils::parallelFor(numEntries, 1, threads, [&](size_t i)
+	{
+		const PrefabHeader& entry = m_entries[i];
+		readers[i] = std::make_unique<RmfReader>(m_file.view(entry.offset, entry.size), m_filepath, m_outputDir);
+	});
+
+	// Texture lookups share the WAD caches and log what they extract, so they run in library order
+	for (std::unique_ptr<RmfReader>& reader : readers)
+		reader->resolveTextures(true);
+
+	std::vector<std::unordered_map<std::string, M2PExport::ModelData>> prefabModels(numEntries);
+	std::vector<std::vector<std::string>> messages(numEntries);
+	M2PUtils::parallelFor(numEntries, 1, threads, [&](size_t i)
 	{
-		std::string filename = M2PUtils::slugify(entry.name);
-		RmfReader reader = RmfReader(m_filepath, m_outputDir, entry.offset);
+		prefabModels[i] = M2PExport::prepareModels(*readers[i], filenames[i], &messages[i]);
+	});
 
-		std::unordered_map<std::string, M2PExport::ModelData> models = M2PExport::prepareModels(reader, filename);
+	for (size_t i = 0; i < numEntries; ++i)
+	{
+		M2PExport::logMessages(messages[i]);
 
+		std::unordered_map<std::string, M2PExport::ModelData>& models = prefabModels[i];
 		if (models.empty())
 		{
-			logger.info("Prefab " + filename + " had no models to convert, skipping");
+			logger.info("Prefab " + filenames[i] + " had no models to convert, skipping");
 			continue;
 		}
 
-		res += M2PExport::processModels(models, reader.hasMissingTextures(), successes);
+		res += M2PExport::processModels(models, readers[i]->hasMissingTextures(), successes);
+
+		models.clear();
+		readers[i].reset();
 	}
 
 	if (res > 0)
@@ -4,6 +4,7 @@
 #include <fstream>
 #include <filesystem>
 #include "entity.h"
+#include "mapped_file.h"
 
 
 namespace M2POL
@@ -38,13 +39,16 @@ namespace M2PFormat
 	{
 	public:
 		OlReader(const std::filesystem::path& filepath, const std::filesystem::path& outputDir);
-		~OlReader();
 
+		/**
+		 * Converts every prefab in the library. The prefabs are parsed and prepared
+		 * on the configured threads, then written out and logged in library order.
+		 */
 		int process();
 	private:
 		std::filesystem::path m_filepath;
 		std::filesystem::path m_outputDir;
-		std::ifstream m_file;
+		M2PUtils::MappedFile m_file;
 		std::vector<M2POL::PrefabHeader> m_entries;
 
 		void parse();
@@ -3,11 +3,13 @@
 #include <cstring>
 #include <format>
 #include <vector>
+#include <algorithm>
 #include <array>
 #include "rmf_format.h"
 #include "logging.h"
 #include "utils.h"
 #include "binutils.h"
+#include "mapped_file.h"
 
 static inline Logging::Logger& logger = Logging::Logger::getLogger("rmfreader");
 
@@ -20,83 +22,60 @@ using namespace M2PBinUtils;
 
 std::string RmfBrush::getRaw() const
 {
-	std::string raw = "{\n";
-	raw.reserve(1024);
-
-	for (const auto& face : faces)
-	{
-		Vertex x = M2PUtils::getCircular(face.vertices, -1);
-		Vertex y = M2PUtils::getCircular(face.vertices, -2);
-		Vertex z = M2PUtils::getCircular(face.vertices, -3);
-		FP ux = face.texture.rightaxis.x, uy = face.texture.rightaxis.y, uz = face.texture.rightaxis.z;
-		FP vx = face.texture.downaxis.x, vy = face.texture.downaxis.y, vz = face.texture.downaxis.z;
-		FP shiftx = face.texture.shiftx, shifty = face.texture.shifty;
-		FP r = face.texture.angle, scalex = face.texture.scalex, scaley = face.texture.scaley;
-
-		raw += std::format("( {:.6g} {:.6g} {:.6g} ) ",    x.x, x.y, x.z);
-		raw += std::format("( {:.6g} {:.6g} {:.6g} ) ",    y.x, y.y, y.z);
-		raw += std::format("( {:.6g} {:.6g} {:.6g} ) {} ", z.x, z.y, z.z, face.texture.name);
-
-		raw += std::format("[ {:.6g} {:.6g} {:.6g} {:.6g} ] ", ux, uy, uz, shiftx);
-		raw += std::format("[ {:.6g} {:.6g} {:.6g} {:.6g} ] ", vx, vy, vz, shifty);
-		raw += std::format("{:.6g} {:.6g} {:.6g}\n",           r, scalex, scaley);
-	}
-
-	raw += "}\n";
-	return raw;
+	M2PUtils::BufferedWriter writer;
+	writeRaw(writer);
+	return writer.str();
 }
 
-std::string RmfEntity::toString() const
+void RmfBrush::writeRaw(M2PUtils::BufferedWriter& writer) const
 {
-	std::string str;
-	str.reserve(1024);
-	str = "{\n";
+	writer.write("{\n");
 
-	for (std::pair<std::string, std::string> const& pair : keyvalues)
-	{
-		str += std::format("\"{}\" \"{}\"\n", pair.first, pair.second);
-	}
-
-	if (!brushes.empty())
+	for (const auto& face : faces)
 	{
-		for (const std::unique_ptr<Brush>& brush : brushes)
-		{
-			str += brush->getRaw();
-		}
+		writeRawFace(writer,
+			M2PUtils::getCircular(face.vertices, -1),
+			M2PUtils::getCircular(face.vertices, -2),
+			M2PUtils::getCircular(face.vertices, -3),
+			face.texture
+		);
 	}
+	for (const RawFace& face : rawFaces)
+		writeRawFace(writer, face.points[0], face.points[1], face.points[2], face.texture);
 
-	str += "}\n";
-
-	return str;
+	writer.write("}\n");
 }
 
-RmfReader::RmfReader(const std::filesystem::path& filepath, const std::filesystem::path& outputDir, int seekTo)
+RmfReader::RmfReader(const std::filesystem::path& filepath, const std::filesystem::path& outputDir)
 {
 	m_filepath = filepath;
 	m_outputDir = outputDir;
-	m_file.open(filepath, std::ios::binary);
-	if (!m_file.is_open() || !m_file.good())
+	M2PUtils::MappedFile file{ filepath };
+	if (!file.isOpen())
 	{
-		m_file.close();
 		logger.error("Could not open file " + filepath.string());
 		exit(EXIT_FAILURE);
 	}
-	if (seekTo)
-		m_file.seekg(seekTo, std::ios::beg);
+	m_cursor = BinaryCursor{ file.view() };
 
 	parse();
-	m_file.close();
+	m_cursor = BinaryCursor{};
+	resolveTextures(true);
 }
-RmfReader::~RmfReader()
+RmfReader::RmfReader(std::string_view data, const std::filesystem::path& filepath, const std::filesystem::path& outputDir)
 {
-	if (m_file.is_open())
-		m_file.close();
+	m_filepath = filepath;
+	m_outputDir = outputDir;
+	m_cursor = BinaryCursor{ data };
+
+	parse();
+	m_cursor = BinaryCursor{};
 }
 
 void RmfReader::parse()
 {
 	RmfHeader header{};
-	m_file.read(reinterpret_cast<char*>(&header), sizeof(RmfHeader));
+	m_cursor.read(header);
 
 	if (strncmp(header.magic, "RMF", 3))
 	{
@@ -111,221 +90,258 @@ void RmfReader::parse()
 		exit(EXIT_FAILURE);
 	}
 
-	std::int32_t visgroupCount = readInt(m_file);
+	std::int32_t visgroupCount = m_cursor.readInt();
 	for (int i = 0; i < visgroupCount; ++i)
 		readVisgroup();
 
-	entities.emplace_back(std::make_unique<RmfEntity>());
+	entities.emplace_back(std::make_unique<Entity>());
 	auto& worldspawn = *entities[0];
 	worldspawn.classname = "worldspawn";
 	worldspawn.keyvalues.emplace_back("classname", worldspawn.classname);
 	worldspawn.keyvalues.emplace_back("mapversion", "220");
 
-	std::string objectType = readLPString(m_file); // CMapWorld
+	m_cursor.readLPString(); // CMapWorld
 	MapObjectData cMapWorldData{};
-	m_file.read(reinterpret_cast<char*>(&cMapWorldData), sizeof(MapObjectData));
+	m_cursor.read(cMapWorldData);
 
 	readChildren(cMapWorldData.childCount, worldspawn);
 
-	std::string classname = readLPString(m_file); // "worldspawn"
+	std::string classname{ m_cursor.readLPString() }; // "worldspawn"
 	if (classname != "worldspawn")
 		throw std::runtime_error("Expected worldspawn, but was \"" + classname + "\"");
 
 	EntityData worldspawnData{};
-	m_file.read(reinterpret_cast<char*>(&worldspawnData), sizeof(EntityData));
+	m_cursor.read(worldspawnData);
 
 	std::string key, value;
 	for (int i = 0; i < worldspawnData.kvCount; ++i)
 	{
-		key = readLPString(m_file);
-		value = readLPString(m_file);
+		key = m_cursor.readLPString();
+		value = m_cursor.readLPString();
 		worldspawn.keyvalues.emplace_back(key, value);
 	}
-	m_file.seekg(12, std::ios::cur); // Padding?
+	m_cursor.skip(12); // Padding?
 
 	if (worldspawnData.spawnflags)
 		worldspawn.setKey("spawnflags", std::to_string(worldspawnData.spawnflags));
 
-	std::int32_t pathCount = readInt(m_file);
+	std::int32_t pathCount = m_cursor.readInt();
 	for (int i = 0; i < pathCount; ++i)
 		readPath();
 
+	// Brushes come before the keyvalues of their entity, so they are only decoded once it is known
+	for (const BrushSlot& slot : m_brushSlots)
+	{
+		m_cursor.seek(slot.offset);
+		if (needsGeometry(*slot.entity))
+			readBrush(*slot.brush);
+		else
+			readRawBrush(*slot.brush);
+	}
+	m_brushSlots.clear();
 }
 
 void RmfReader::readChildren(int count, Entity &parent)
 {
-	std::string objectType;
+	std::string_view objectType;
 
 	for (int i = 0; i < count; ++i)
 	{
-		objectType = readLPString(m_file);
+		objectType = m_cursor.readLPString();
 
 		if (objectType == "CMapSolid")
 		{
 			parent.brushes.emplace_back(std::make_unique<RmfBrush>());
-			Brush& brush = *parent.brushes.back();
-			readBrush(brush);
+			m_brushSlots.push_back({ parent.brushes.back().get(), &parent, m_cursor.offset() });
+			skipBrush();
 			continue;
 		}
 		if (objectType == "CMapEntity")
 		{
-			entities.emplace_back(std::make_unique<RmfEntity>());
+			entities.emplace_back(std::make_unique<Entity>());
 			readEntity(*entities.back());
 			continue;
 		}
-		if (objectType == std::string{ "CMapGroup" })
+		if (objectType == "CMapGroup")
 		{
 			readGroup(parent);
 			continue;
 		}
 
-		throw std::runtime_error("Invalid object type: \"" + objectType + "\"");
+		throw std::runtime_error("Invalid object type: \"" + std::string(objectType) + "\"");
 	}
 }
 
 void RmfReader::readVisgroup()
 {
 	Visgroup visgroup{};
-	m_file.read(reinterpret_cast<char*>(&visgroup), sizeof(Visgroup));
+	m_cursor.read(visgroup);
 }
 
 
 void RmfReader::readEntity(Entity& entity)
 {
 	MapObjectData objectData{};
-	m_file.read(reinterpret_cast<char*>(&objectData), sizeof(MapObjectData));
+	m_cursor.read(objectData);
 
 	readChildren(objectData.childCount, entity);
 
-	entity.classname = readLPString(m_file);
+	entity.classname = m_cursor.readLPString();
 	entity.setKey("classname", entity.classname);
 
 	EntityData entData{};
-	m_file.read(reinterpret_cast<char*>(&entData), sizeof(EntityData));
+	m_cursor.read(entData);
 
 	std::string key, value;
 	for (int i = 0; i < entData.kvCount; ++i)
 	{
-		key = readLPString(m_file);
-		value = readLPString(m_file);
+		key = m_cursor.readLPString();
+		value = m_cursor.readLPString();
 		entity.keyvalues.emplace_back(key, value);
 	}
 
-	m_file.seekg(14, std::ios::cur); // Padding?
+	m_cursor.skip(14); // Padding?
 
 	if (entData.spawnflags && !entity.hasKey("spawnflags"))
 		entity.setKey("spawnflags", std::to_string(entData.spawnflags));
 
 	float origin[3]{};
-	m_file.read(reinterpret_cast<char*>(&origin), sizeof(origin));
+	m_cursor.read(origin);
 
 	if (entity.brushes.empty())
 		entity.setKey("origin", std::format("{:.6g} {:.6g} {:.6g}", origin[0], origin[1], origin[2]));
 
-	m_file.seekg(4, std::ios::cur); // Padding?
+	m_cursor.skip(4); // Padding?
 }
 
-void RmfReader::readBrush(Brush& brush)
+void RmfReader::skipBrush()
 {
 	MapObjectData objectData{};
-	m_file.read(reinterpret_cast<char*>(&objectData), sizeof(MapObjectData));
-	//readChildren(objectData.childCount, parent);
+	m_cursor.read(objectData);
+
+	const size_t nameLength = (m_version < 18) ? 40 : 260;
+	const size_t axesLength = (m_version < 22) ? sizeof(float[3]) : sizeof(float[9]);
+	const size_t paddingLength = (m_version < 18) ? 4 : 16;
 
-	std::int32_t faceCount = readInt(m_file);
+	std::int32_t faceCount = m_cursor.readInt();
 	for (int i = 0; i < faceCount; ++i)
 	{
-		Face face = readFace();
-		brush.faces.push_back(face);
+		m_cursor.skip(nameLength + axesLength + sizeof(float[2]) + paddingLength);
+		std::int32_t vertexCount = m_cursor.readInt();
+		m_cursor.skip(sizeof(float[3]) * std::max(vertexCount, 0) + sizeof(float[3][3]));
 	}
 }
 
-M2PEntity::Face RmfReader::readFace()
+void RmfReader::readBrush(Brush& brush)
 {
-	Face face;
+	MapObjectData objectData{};
+	m_cursor.read(objectData);
+	//readChildren(objectData.childCount, parent);
 
-	face.texture.name = (m_version < 18) ? readNTString(m_file, 40) : readNTString(m_file, 260);
+	std::int32_t faceCount = m_cursor.readInt();
+	brush.faces.reserve(std::max(faceCount, 0));
+	for (int i = 0; i < faceCount; ++i)
+		brush.faces.push_back(readFace());
+}
+
+void RmfReader::readRawBrush(Brush& brush)
+{
+	MapObjectData objectData{};
+	m_cursor.read(objectData);
 
-	M2PWad3::ImageSize imageInfo = wadHandler.checkTexture(face.texture.name);
+	std::int32_t faceCount = m_cursor.readInt();
+	brush.rawFaces.reserve(std::max(faceCount, 0));
+	for (int i = 0; i < faceCount; ++i)
+		brush.rawFaces.push_back(readRawFace());
+}
 
-	face.texture.width = imageInfo.width;
-	face.texture.height = imageInfo.height;
+void RmfReader::readTexture(Texture& texture)
+{
+	texture.name = (m_version < 18) ? m_cursor.readNTString(40) : m_cursor.readNTString(260);
 
 	if (m_version < 22)
 	{
-		face.texture.angle = readFloat(m_file);
-		face.texture.shiftx = readFloat(m_file);
-		face.texture.shifty = readFloat(m_file);
+		texture.angle = m_cursor.readFloat();
+		texture.shiftx = m_cursor.readFloat();
+		texture.shifty = m_cursor.readFloat();
 	}
 	else
 	{
 		float rightaxis[3]{}, downaxis[3]{};
-		m_file.read(reinterpret_cast<char*>(&rightaxis), sizeof(rightaxis));
-		face.texture.shiftx = readFloat(m_file);
-		m_file.read(reinterpret_cast<char*>(&downaxis), sizeof(downaxis));
-		face.texture.shifty = readFloat(m_file);
-		face.texture.angle = readFloat(m_file);
-
-		face.texture.rightaxis = Vector3(rightaxis);
-		face.texture.downaxis = Vector3(downaxis);
+		m_cursor.read(rightaxis);
+		texture.shiftx = m_cursor.readFloat();
+		m_cursor.read(downaxis);
+		texture.shifty = m_cursor.readFloat();
+		texture.angle = m_cursor.readFloat();
+
+		texture.rightaxis = Vector3(rightaxis);
+		texture.downaxis = Vector3(downaxis);
 	}
-	face.texture.scalex = readFloat(m_file);
-	face.texture.scaley = readFloat(m_file);
+	texture.scalex = m_cursor.readFloat();
+	texture.scaley = m_cursor.readFloat();
 
 	// Padding
 	if (m_version < 18)
-		m_file.seekg(4, std::ios::cur);
+		m_cursor.skip(4);
 	else
-		m_file.seekg(16, std::ios::cur);
+		m_cursor.skip(16);
+}
 
-	std::int32_t vertexCount = readInt(m_file);
+M2PEntity::Face RmfReader::readFace()
+{
+	Face face;
+	readTexture(face.texture);
+
+	std::int32_t vertexCount = m_cursor.readInt();
+	face.vertices.reserve(std::max(vertexCount, 0));
 	float coord[3]{};
 	for (int i = 0; i < vertexCount; ++i)
 	{
-		m_file.read(reinterpret_cast<char*>(&coord), sizeof(coord));
+		m_cursor.read(coord);
 		face.vertices.emplace_back(coord[0], coord[1], coord[2]);
 	}
 	std::reverse(face.vertices.begin(), face.vertices.end());
 
 	float planepoints[3][3]{};
-	m_file.read(reinterpret_cast<char*>(&planepoints), sizeof(planepoints));
+	m_cursor.read(planepoints);
 
 	Vector3 normalPoints[3] = { Vector3(planepoints[2]), Vector3(planepoints[1]), Vector3(planepoints[0]) };
 	face.normal = planeNormal(normalPoints);
 
 	if (m_version < 22)
-	{
-		Vector3 normalPoints[3] = { Vector3(planepoints[2]), Vector3(planepoints[1]), Vector3(planepoints[0]) };
-		Vector3 normal = planeNormal(normalPoints);
-		FP vecs[2][3]{};
-		int sv, tv;
-		FP theta = deg2rad(face.texture.angle);
-		FP sinv = sin(theta), cosv = cos(theta);
-		textureAxisFromPlane(normal, vecs[0], vecs[1]);
-
-		if (static_cast<int>(round(vecs[0][0]))) sv = 0;
-		else if (static_cast<int>(round(vecs[0][1]))) sv = 1;
-		else sv = 2;
-
-		if (static_cast<int>(round(vecs[1][0]))) tv = 0;
-		else if (static_cast<int>(round(vecs[1][1]))) tv = 1;
-		else tv = 2;
-
-		for (int i = 0; i < 2; ++i)
-		{
-			FP ns = cosv * vecs[i][sv] - sinv * vecs[i][tv];
-			FP nt = sinv * vecs[i][sv] + cosv * vecs[i][tv];
-			vecs[i][sv] = ns;
-			vecs[i][tv] = nt;
-		}
+		textureAxesFromAngle(face.normal, face.texture);
+
+	for (M2PGeo::Vertex& vertex : face.vertices)
+		vertex.normal = face.normal;
+
+	return face;
+}
+
+M2PEntity::RawFace RmfReader::readRawFace()
+{
+	RawFace face;
+	readTexture(face.texture);
+
+	// Only the first three vertices are written back out
+	std::int32_t vertexCount = m_cursor.readInt();
+	if (vertexCount < 3)
+		throw std::runtime_error(std::format("Face with {} vertices at offset {}", vertexCount, m_cursor.offset()));
 
-		face.texture.rightaxis = { vecs[0] };
-		face.texture.downaxis = { vecs[1] };
+	float coord[3]{};
+	for (Vector3& point : face.points)
+	{
+		m_cursor.read(coord);
+		point = Vector3(coord);
 	}
+	m_cursor.skip(sizeof(float[3]) * (vertexCount - 3));
 
-	for (M2PGeo::Vertex& vertex : face.vertices)
+	float planepoints[3][3]{};
+	m_cursor.read(planepoints);
+
+	if (m_version < 22)
 	{
-		vertex.uv = face.texture.uvForPoint(vertex);
-		vertex.normal = face.normal;
+		Vector3 normalPoints[3] = { Vector3(planepoints[2]), Vector3(planepoints[1]), Vector3(planepoints[0]) };
+		textureAxesFromAngle(planeNormal(normalPoints), face.texture);
 	}
 
 	return face;
@@ -334,16 +350,16 @@ M2PEntity::Face RmfReader::readFace()
 void RmfReader::readGroup(Entity &parent)
 {
 	MapObjectData objectData{};
-	m_file.read(reinterpret_cast<char*>(&objectData), sizeof(MapObjectData));
+	m_cursor.read(objectData);
 	readChildren(objectData.childCount, parent);
 }
 
 void RmfReader::readPath()
 {
-	std::string name = readNTString(m_file, 128);
-	std::string classname = readNTString(m_file, 128);
-	readInt(m_file); // pathType
-	std::int32_t nodeCount = readInt(m_file);
+	m_cursor.readNTString(128); // name
+	m_cursor.readNTString(128); // classname
+	m_cursor.readInt(); // pathType
+	std::int32_t nodeCount = m_cursor.readInt();
 	for (int i = 0; i < nodeCount; ++i)
 		readPathNode();
 }
@@ -351,19 +367,47 @@ void RmfReader::readPath()
 void RmfReader::readPathNode()
 {
 	float position[3]{};
-	m_file.read(reinterpret_cast<char*>(&position), sizeof(position));
-	readInt(m_file); // index
-	std::string targetname = readNTString(m_file, 128);
-	std::int32_t kvCount = readInt(m_file);
+	m_cursor.read(position);
+	m_cursor.readInt(); // index
+	m_cursor.readNTString(128); // targetname
+	std::int32_t kvCount = m_cursor.readInt();
 	std::string key, value;
 	for (int i = 0; i < kvCount; ++i)
 	{
-		key = readLPString(m_file);
-		value = readLPString(m_file);
+		key = m_cursor.readLPString();
+		value = m_cursor.readLPString();
 	}
 }
 
 
+void M2PRMF::textureAxesFromAngle(const Vector3 normal, Texture& texture)
+{
+	FP vecs[2][3]{};
+	int sv, tv;
+	FP theta = deg2rad(texture.angle);
+	FP sinv = sin(theta), cosv = cos(theta);
+	textureAxisFromPlane(normal, vecs[0], vecs[1]);
+
+	if (static_cast<int>(round(vecs[0][0]))) sv = 0;
+	else if (static_cast<int>(round(vecs[0][1]))) sv = 1;
+	else sv = 2;
+
+	if (static_cast<int>(round(vecs[1][0]))) tv = 0;
+	else if (static_cast<int>(round(vecs[1][1]))) tv = 1;
+	else tv = 2;
+
+	for (int i = 0; i < 2; ++i)
+	{
+		FP ns = cosv * vecs[i][sv] - sinv * vecs[i][tv];
+		FP nt = sinv * vecs[i][sv] + cosv * vecs[i][tv];
+		vecs[i][sv] = ns;
+		vecs[i][tv] = nt;
+	}
+
+	texture.rightaxis = { vecs[0] };
+	texture.downaxis = { vecs[1] };
+}
+
 void M2PRMF::textureAxisFromPlane(const Vector3 normal, FP xvOut[3], FP yvOut[3])
 {
 	int bestaxis = 0;
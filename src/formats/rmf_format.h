@@ -3,7 +3,10 @@
 #include <fstream>
 #include <filesystem>
 #include <array>
+#include <string_view>
+#include <vector>
 #include "entity.h"
+#include "binutils.h"
 #include "geometry.h"
 
 
@@ -60,15 +63,12 @@ namespace M2PRMF
 	{
 	public:
 		std::string getRaw() const override;
-	};
-
-	class RmfEntity : public M2PEntity::Entity
-	{
-	public:
-		std::string toString() const override;
+		void writeRaw(M2PUtils::BufferedWriter& writer) const override;
 	};
 
 	void textureAxisFromPlane(const M2PGeo::Vector3 normal, FP xvOut[3], FP yvOut[3]);
+	/** Texture axes of RMF versions that only store a rotation, from the face normal and the texture angle */
+	void textureAxesFromAngle(const M2PGeo::Vector3 normal, M2PGeo::Texture& texture);
 }
 
 namespace M2PFormat
@@ -76,13 +76,26 @@ namespace M2PFormat
 	class RmfReader : public M2PEntity::BaseReader
 	{
 	public:
-		RmfReader(const std::filesystem::path& filepath, const std::filesystem::path& outputDir, int seekTo = 0);
-		~RmfReader();
+		RmfReader(const std::filesystem::path& filepath, const std::filesystem::path& outputDir);
+		/**
+		 * Reads an RMF already in memory, such as a prefab in a library.
+		 * Only parses, so the caller resolves the textures with resolveTextures(true).
+		 * @param filepath File the data came from, for messages
+		 */
+		RmfReader(std::string_view data, const std::filesystem::path& filepath, const std::filesystem::path& outputDir);
 	private:
 		int m_version;
 		std::filesystem::path m_filepath;
 		std::filesystem::path m_outputDir;
-		std::ifstream m_file;
+		M2PBinUtils::BinaryCursor m_cursor;
+		/** Where a brush starts in the file and the entity it belongs to */
+		struct BrushSlot
+		{
+			M2PEntity::Brush* brush;
+			const M2PEntity::Entity* entity;
+			size_t offset;
+		};
+		std::vector<BrushSlot> m_brushSlots;
 
 		void parse();
 
@@ -92,7 +105,11 @@ namespace M2PFormat
 		void readPath();
 		void readPathNode();
 		void readEntity(M2PEntity::Entity &entity);
+		void skipBrush();
 		void readBrush(M2PEntity::Brush &brush);
+		void readRawBrush(M2PEntity::Brush &brush);
+		void readTexture(M2PGeo::Texture &texture);
 		M2PEntity::Face readFace();
+		M2PEntity::RawFace readRawFace();
 	};
 }
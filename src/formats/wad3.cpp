@@ -1,12 +1,14 @@
+#include <array>
+#include <cctype>
 #include <cstring>
+#include <algorithm>
+#include <stdexcept>
 #include "utils.h"
 #include "config.h"
-#include "logging.h"
 #include "wad3.h"
 #include "bmp8bpp.h"
 
 
-static inline Logging::Logger& logger = Logging::Logger::getLogger("wad3reader");
 using M2PConfig::g_config;
 
 using namespace M2PWad3;
@@ -14,66 +16,81 @@ using namespace M2PUtils;
 using namespace M2PBmp;
 
 
+/**
+ * Lowercases a texture name into a buffer the size of a directory entry name.
+ * Returns false for names too long to be in any WAD.
+ */
+static inline bool foldName(std::string_view name, std::array<char, c_MAXTEXTURENAME>& buffer, std::string_view& folded)
+{
+	if (name.size() > buffer.size())
+		return false;
+
+	std::transform(name.begin(), name.end(), buffer.begin(), [](unsigned char c) {
+		return static_cast<char>(std::tolower(c));
+	});
+	folded = std::string_view(buffer.data(), name.size());
+	return true;
+}
+
 Wad3Reader::Wad3Reader(const std::filesystem::path& filepath)
 {
 	m_filepath = filepath;
-	open();
+	std::ifstream file = open();
 
 	Wad3Header header{};
-	m_file.read(reinterpret_cast<char*>(&header), sizeof(Wad3Header));
+	file.read(reinterpret_cast<char*>(&header), sizeof(Wad3Header));
 
 	if (strncmp(header.szMagic, "WAD3", 4))
 	{
-		m_file.close();
-		logger.warning("Invalid file type: \""
+		throw std::runtime_error("Invalid file type: \""
 			+ std::filesystem::absolute(filepath).string() + "\" is not a valid WAD3 package.");
-		throw std::runtime_error("Invalid file type");
 	}
 
-	m_file.seekg(header.nDirOffset, std::ios::beg);
+	file.seekg(header.nDirOffset, std::ios::beg);
 	m_dirEntries.assign(header.nDir, {});
 	for (int i = 0; i < header.nDir; ++i)
-		m_file.read(reinterpret_cast<char*>(&(m_dirEntries[i])), sizeof(Wad3DirEntry));
+		file.read(reinterpret_cast<char*>(&(m_dirEntries[i])), sizeof(Wad3DirEntry));
 
-	m_file.close();
-}
-Wad3Reader::~Wad3Reader()
-{
-	if (m_file.is_open())
-		m_file.close();
+	m_dirIndex.reserve(m_dirEntries.size());
+	for (size_t i = 0; i < m_dirEntries.size(); ++i)
+	{
+		const char* name = m_dirEntries[i].szName;
+		m_dirIndex.try_emplace(toLowerCase(std::string(name, strnlen(name, c_MAXTEXTURENAME))), i);
+	}
 }
-void M2PWad3::Wad3Reader::open()
+std::ifstream Wad3Reader::open() const
 {
-	m_file.open(m_filepath, std::ios::binary);
-	if (!m_file.is_open() || !m_file.good())
+	std::ifstream file{ m_filepath, std::ios::binary };
+	if (!file.is_open() || !file.good())
 	{
-		m_file.close();
-		logger.error("Could not open file " + m_filepath.string());
-		exit(EXIT_FAILURE);
+		// Extraction runs on worker threads, so this is left for the caller to report
+		throw std::runtime_error("Could not open file " + m_filepath.string());
 	}
+	return file;
 }
 std::string Wad3Reader::getFilename() const
 {
 	return m_filepath.filename().string();
 }
-Wad3DirEntry* Wad3Reader::getDirEntry(const std::string& textureName)
+const Wad3DirEntry* Wad3Reader::getDirEntry(const std::string& textureName) const
 {
-	for (Wad3DirEntry& dirEntry : m_dirEntries)
-	{
-		if (M2PUtils::toLowerCase(textureName) == M2PUtils::toLowerCase(dirEntry.szName))
-			return &dirEntry;
-	}
-	return nullptr;
+	std::array<char, c_MAXTEXTURENAME> buffer;
+	std::string_view folded;
+	if (!foldName(textureName, buffer, folded))
+		return nullptr;
+
+	const auto it = m_dirIndex.find(folded);
+	return it != m_dirIndex.end() ? &m_dirEntries[it->second] : nullptr;
 }
-bool Wad3Reader::contains(const std::string& textureName)
+bool Wad3Reader::contains(const std::string& textureName) const
 {
 	return getDirEntry(textureName) != nullptr;
 }
-Wad3MipTex Wad3Reader::extract(const std::string& textureName, const std::filesystem::path& outdir)
+Wad3MipTex Wad3Reader::extract(const std::string& textureName, const std::filesystem::path& outdir) const
 {
 	// Read texture data from WAD
 
-	Wad3DirEntry* dirEntry = getDirEntry(textureName);
+	const Wad3DirEntry* dirEntry = getDirEntry(textureName);
 	if (dirEntry == nullptr)
 	{
 		throw std::runtime_error("Could not extract \"" + textureName + "\" from " + getFilename());
@@ -84,31 +101,31 @@ Wad3MipTex Wad3Reader::extract(const std::string& textureName, const std::filesy
 		throw std::runtime_error("Texture \"" + textureName + "\" is not a MipTex type");
 	}
 
-	open();
+	std::ifstream file = open();
 
-	m_file.seekg(dirEntry->nFilePos);
+	file.seekg(dirEntry->nFilePos);
 
 	Wad3MipTex miptex{};
-	m_file.read((char*)&miptex, sizeof(Wad3MipTex));
+	file.read((char*)&miptex, sizeof(Wad3MipTex));
 
 	size_t width = miptex.nWidth;
 	size_t height = miptex.nHeight;
 	size_t textureSize = width * height;
 	std::vector<unsigned char> data(textureSize, {});
 
-	m_file.seekg(dirEntry->nFilePos + miptex.nOffsets[0]);
+	file.seekg(dirEntry->nFilePos + miptex.nOffsets[0]);
 
-	m_file.read((char*)data.data(), textureSize);  // Read mipmap 0
+	file.read((char*)data.data(), textureSize);  // Read mipmap 0
 
-	m_file.seekg((width >> 1) * (height >> 1), std::ios::cur);  // Skip mipmap 1
-	m_file.seekg((width >> 2) * (height >> 2), std::ios::cur);  // Skip mipmap 2
-	m_file.seekg((width >> 3) * (height >> 3), std::ios::cur);  // Skip mipmap 3
-	m_file.seekg(sizeof(int16_t), std::ios::cur); // Skip colours used (always 256 here)
+	file.seekg((width >> 1) * (height >> 1), std::ios::cur);  // Skip mipmap 1
+	file.seekg((width >> 2) * (height >> 2), std::ios::cur);  // Skip mipmap 2
+	file.seekg((width >> 3) * (height >> 3), std::ios::cur);  // Skip mipmap 3
+	file.seekg(sizeof(int16_t), std::ios::cur); // Skip colours used (always 256 here)
 
 	unsigned char palette[c_PALETTESIZE]{};
-	m_file.read((char*)&palette[0], c_PALETTESIZE);
+	file.read((char*)&palette[0], c_PALETTESIZE);
 
-	m_file.close();
+	file.close();
 
 
 	// Prepare data for BMP
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <unordered_map>
+#include <functional>
 #include <fstream>
 #include <filesystem>
 #include <map>
@@ -54,17 +57,24 @@ namespace M2PWad3
     public:
         Wad3Reader() {};
         Wad3Reader(const std::filesystem::path&);
-        ~Wad3Reader();
 
         std::string getFilename() const;
-        bool contains(const std::string& textureName);
-        Wad3MipTex extract(const std::string& textureName, const std::filesystem::path& filepath);
+        bool contains(const std::string& textureName) const;
+        /** Safe to call from several threads, each call opens its own stream */
+        Wad3MipTex extract(const std::string& textureName, const std::filesystem::path& filepath) const;
     private:
         std::filesystem::path m_filepath;
         std::vector<Wad3DirEntry> m_dirEntries;
-        std::ifstream m_file;
 
-        void open();
-        Wad3DirEntry* getDirEntry(const std::string& textureName);
+        struct NameHash
+        {
+            using is_transparent = void;
+            size_t operator()(std::string_view name) const noexcept { return std::hash<std::string_view>{}(name); }
+        };
+        /** Lowercased entry names to their position in m_dirEntries, the first entry wins */
+        std::unordered_map<std::string, size_t, NameHash, std::equal_to<>> m_dirIndex;
+
+        std::ifstream open() const;
+        const Wad3DirEntry* getDirEntry(const std::string& textureName) const;
     };
 }
@@ -1,6 +1,8 @@
+#include <stdexcept>
 #include "config.h"
 #include "logging.h"
 #include "utils.h"
+#include "parallel.h"
 #include "bmp8bpp.h"
 #include "wad3handler.h"
 
@@ -19,16 +21,12 @@ ImageInfo::ImageInfo(const std::pair<int, int>& size)
 }
 ImageInfo::ImageInfo(const std::string& textureName)
 {
-	if (!std::filesystem::exists(g_config.extractDir()))
-		std::filesystem::create_directories(g_config.extractDir());
-
 	std::filesystem::path textureFile = g_config.extractDir() / (toLowerCase(textureName) + ".bmp");
 	m_file.open(textureFile, std::ios::binary);
 	if (!m_file.is_open() || !m_file.good())
 	{
 		m_file.close();
-		logger.error("Could not find texture " + std::filesystem::absolute(textureFile).string());
-		exit(EXIT_FAILURE);
+		throw std::runtime_error("Could not find texture " + std::filesystem::absolute(textureFile).string());
 	}
 	m_file.seekg(14, std::ios::beg);
 	M2PBmp::BMPInfoHeader infoHeader{};
@@ -67,7 +65,7 @@ std::ostream& M2PWad3::operator<<(std::ostream& os, const ImageSize& size)
 	return os;
 }
 
-Wad3Reader& Wad3Handler::getWad3Reader(const std::filesystem::path& wad)
+std::shared_ptr<const Wad3Reader> Wad3Handler::getWad3Reader(const std::filesystem::path& wad)
 {
 	if (!s_wadCache.contains(wad))
 	{
@@ -75,27 +73,28 @@ Wad3Reader& Wad3Handler::getWad3Reader(const std::filesystem::path& wad)
 		if (g_config.wadCache > 0 && s_wadCache.size() >= g_config.wadCache)
 			s_wadCache.erase(s_wadCache.begin());
 
-		s_wadCache.insert(std::pair(wad, wad));
+		s_wadCache.insert(std::pair(wad, std::make_shared<const Wad3Reader>(wad)));
 	}
 	return s_wadCache[wad];
 }
 
-Wad3Reader* Wad3Handler::checkWads(const std::string& textureName)
+std::shared_ptr<const Wad3Reader> Wad3Handler::checkWads(const std::string& textureName)
 {
 	for (const std::filesystem::path& wad : g_config.wadList)
 	{
 		try
 		{
-			Wad3Reader& reader = getWad3Reader(wad);
-			if (reader.contains(textureName))
+			std::shared_ptr<const Wad3Reader> reader = getWad3Reader(wad);
+			if (reader->contains(textureName))
 			{
 				if (!contains(usedWads, wad))
 					usedWads.push_back(wad);
-				return &reader;
+				return reader;
 			}
 		}
-		catch (std::runtime_error&)
+		catch (const std::runtime_error& e)
 		{
+			logger.warning(e.what());
 			continue;
 		}
 	}
@@ -104,49 +103,117 @@ Wad3Reader* Wad3Handler::checkWads(const std::string& textureName)
 
 ImageSize Wad3Handler::checkTexture(const std::string& textureName)
 {
-	if (s_images.contains(textureName))
-		return s_images[textureName];
+	if (!s_images.contains(textureName))
+		resolveTextures({ textureName });
 
-	if (isSkipTexture(textureName) || isToolTexture(textureName))
+	return s_images[textureName];
+}
+
+void Wad3Handler::findWads(const std::vector<std::string>& textureNames)
+{
+	for (const std::string& textureName : textureNames)
 	{
-		s_images.insert(std::pair{ textureName, ImageSize(16, 16) });
-		return Wad3Handler::s_images[textureName];
+		if (s_images.contains(textureName) || isSkipTexture(textureName) || isToolTexture(textureName))
+			continue;
+		checkWads(textureName);
 	}
+}
 
-	std::string textureFile = toLowerCase(textureName) + ".bmp";
+void Wad3Handler::resolveTextures(const std::vector<std::string>& textureNames)
+{
+	enum class Source { EXTRACT_DIR, INPUT_DIR, WAD };
+	struct PendingTexture
+	{
+		std::string name;
+		std::shared_ptr<const Wad3Reader> wad;
+		Source source = Source::WAD;
+		ImageSize size;
+	};
+
+	std::vector<PendingTexture> pending;
+	// Names only differing in case share one BMP, so only the first of them reads or writes it
+	std::unordered_map<std::string, size_t> pendingFiles;
+	std::vector<std::pair<std::string, size_t>> sameFiles;
+
+	for (const std::string& textureName : textureNames)
+	{
+		if (s_images.contains(textureName))
+			continue;
 
-	Wad3Reader* reader = checkWads(textureName);
+		if (isSkipTexture(textureName) || isToolTexture(textureName))
+		{
+			s_images.insert(std::pair{ textureName, ImageSize(16, 16) });
+			continue;
+		}
 
-	if (!std::filesystem::exists(g_config.extractDir()))
-		std::filesystem::create_directories(g_config.extractDir());
+		std::shared_ptr<const Wad3Reader> wad = checkWads(textureName);
 
-	if (std::filesystem::exists(g_config.extractDir() / textureFile))
-		return s_getImageInfo(textureName);
+		auto [file, inserted] = pendingFiles.try_emplace(toLowerCase(textureName), pending.size());
+		if (inserted)
+			pending.push_back({ textureName, std::move(wad) });
+		else
+			sameFiles.emplace_back(textureName, file->second);
+	}
 
-	if (std::filesystem::exists(g_config.inputDir / textureFile))
+	if (pending.empty())
+		return;
+
+	const std::filesystem::path extractDir = g_config.extractDir();
+	if (!std::filesystem::exists(extractDir))
+		std::filesystem::create_directories(extractDir);
+
+	const unsigned int threads = static_cast<unsigned int>(g_config.threads);
+
+	parallelFor(pending.size(), 1, threads, [&](size_t i)
 	{
-		std::filesystem::copy_file(g_config.inputDir / textureFile, g_config.extractDir() / textureFile);
-		return s_getImageInfo(textureName);
-	}
+		const std::string textureFile = toLowerCase(pending[i].name) + ".bmp";
+		if (std::filesystem::exists(extractDir / textureFile))
+			pending[i].source = Source::EXTRACT_DIR;
+		else if (std::filesystem::exists(g_config.inputDir / textureFile))
+			pending[i].source = Source::INPUT_DIR;
+	});
 
-	if (reader == nullptr)
+	for (const PendingTexture& texture : pending)
 	{
-		logger.error("Could not find nor extract texture \"" + textureName
-			+ "\" from any .wad packages. Please place a .wad package "
-			"containing the texture in the input directory or the chosen game directory "
-			"and re-run the application.");
-		exit(EXIT_FAILURE);
+		if (texture.source != Source::WAD)
+			continue;
+
+		if (texture.wad == nullptr)
+		{
+			logger.error("Could not find nor extract texture \"" + texture.name
+				+ "\" from any .wad packages. Please place a .wad package "
+				"containing the texture in the input directory or the chosen game directory "
+				"and re-run the application.");
+			exit(EXIT_FAILURE);
+		}
+
+		logger.info("Extracting " + texture.name + " from " + texture.wad->getFilename());
 	}
 
-	logger.info("Extracting " + textureName + " from " + reader->getFilename());
+	parallelFor(pending.size(), 1, threads, [&](size_t i)
+	{
+		PendingTexture& texture = pending[i];
+		if (texture.source == Source::WAD)
+		{
+			Wad3MipTex miptex = texture.wad->extract(texture.name, extractDir);
+			texture.size = ImageSize(static_cast<int>(miptex.nWidth), static_cast<int>(miptex.nHeight));
+			return;
+		}
 
-	Wad3MipTex miptex = reader->extract(textureName, g_config.extractDir());
+		if (texture.source == Source::INPUT_DIR)
+		{
+			const std::string textureFile = toLowerCase(texture.name) + ".bmp";
+			std::filesystem::copy_file(g_config.inputDir / textureFile, extractDir / textureFile);
+		}
 
-	s_images.insert(std::pair{
-		textureName,
-		ImageSize(static_cast<int>(miptex.nWidth), static_cast<int>(miptex.nHeight))
+		ImageInfo info{ texture.name };
+		texture.size = { info.width, info.height };
 	});
-	return Wad3Handler::s_images[textureName];
+
+	for (const PendingTexture& texture : pending)
+		s_images[texture.name] = texture.size;
+	for (const auto& [textureName, index] : sameFiles)
+		s_images[textureName] = pending[index].size;
 }
 bool Wad3Handler::isToolTexture(const std::string& textureName)
 {
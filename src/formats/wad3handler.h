@@ -5,6 +5,7 @@
 #include <array>
 #include <format>
 #include <map>
+#include <memory>
 #include <unordered_map>
 #include "wad3.h"
 
@@ -50,6 +51,13 @@ namespace M2PWad3
         std::vector<std::filesystem::path> usedWads;
 
         ImageSize checkTexture(const std::string& textureName);
+        /**
+         * Finds the size of each texture not seen before, extracting the missing ones from the WADs.
+         * WAD lookups and logs follow the given order, the file work runs on the configured threads
+         */
+        void resolveTextures(const std::vector<std::string>& textureNames);
+        /** Adds the WADs holding the given textures to usedWads, in order, without extracting anything */
+        void findWads(const std::vector<std::string>& textureNames);
         bool hasMissingTextures() const;
 
         static ImageSize s_getImageInfo(const std::string& textureName);
@@ -58,10 +66,10 @@ namespace M2PWad3
     private:
         bool m_missingTextures = false;
 
-        Wad3Reader& getWad3Reader(const std::filesystem::path& wad);
-        Wad3Reader* checkWads(const std::string&);
+        std::shared_ptr<const Wad3Reader> getWad3Reader(const std::filesystem::path& wad);
+        std::shared_ptr<const Wad3Reader> checkWads(const std::string&);
 
-        static inline std::map<std::filesystem::path, Wad3Reader> s_wadCache;
+        static inline std::map<std::filesystem::path, std::shared_ptr<const Wad3Reader>> s_wadCache;
         static inline std::unordered_map<std::string, ImageSize> s_images;
     };
 }
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include "bounds_tree.h"
+
+
+using namespace M2PGeo;
+
+static inline constexpr std::uint32_t c_LEAF_SIZE = 4;
+static inline constexpr int c_MAX_DEPTH = 64;
+
+
+static inline Bounds enclose(std::vector<Bounds>::const_iterator first, std::vector<Bounds>::const_iterator last)
+{
+	Bounds result = *first;
+	for (auto it = first + 1; it != last; ++it)
+	{
+		result.min.x = std::min(result.min.x, it->min.x);
+		result.min.y = std::min(result.min.y, it->min.y);
+		result.min.z = std::min(result.min.z, it->min.z);
+		result.max.x = std::max(result.max.x, it->max.x);
+		result.max.y = std::max(result.max.y, it->max.y);
+		result.max.z = std::max(result.max.z, it->max.z);
+	}
+	return result;
+}
+
+static inline bool pointInsideInclusive(const Bounds& bounds, const Vector3& p)
+{
+	return p.x >= bounds.min.x && p.x <= bounds.max.x
+		&& p.y >= bounds.min.y && p.y <= bounds.max.y
+		&& p.z >= bounds.min.z && p.z <= bounds.max.z;
+}
+
+
+BoundsTree::BoundsTree(const std::vector<Bounds>& bounds) : m_bounds(bounds)
+{
+	if (m_bounds.empty())
+		return;
+
+	m_nodes.reserve(2 * m_bounds.size() / c_LEAF_SIZE + 1);
+	build(0, static_cast<std::uint32_t>(m_bounds.size()));
+}
+
+void BoundsTree::build(std::uint32_t first, std::uint32_t count)
+{
+	const auto begin = m_bounds.begin() + first;
+	const auto end = begin + count;
+
+	const std::uint32_t index = static_cast<std::uint32_t>(m_nodes.size());
+	m_nodes.push_back(Node{ .bounds = enclose(begin, end), .first = first, .count = count });
+
+	if (count <= c_LEAF_SIZE)
+		return;
+
+	// Split at the median centre along the longest axis
+	const Vector3 size = m_nodes[index].bounds.getSize();
+	int axis = 0;
+	if (size.y > size.x) axis = 1;
+	if (size.z > (axis ? size.y : size.x)) axis = 2;
+
+	const std::uint32_t half = count / 2;
+	std::nth_element(begin, begin + half, end, [axis](const Bounds& a, const Bounds& b)
+		{
+			return a.min.v[axis] + a.max.v[axis] < b.min.v[axis] + b.max.v[axis];
+		});
+
+	m_nodes[index].count = 0;
+	build(first, half);
+	m_nodes[index].right = static_cast<std::uint32_t>(m_nodes.size());
+	build(first + half, count - half);
+}
+
+bool BoundsTree::contains(const Vector3& point) const
+{
+	if (m_nodes.empty())
+		return false;
+
+	std::uint32_t stack[c_MAX_DEPTH];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0)
+	{
+		const std::uint32_t index = stack[--top];
+		const Node& node = m_nodes[index];
+		if (!pointInsideInclusive(node.bounds, point))
+			continue;
+
+		if (node.count > 0)
+		{
+			for (std::uint32_t i = node.first; i < node.first + node.count; ++i)
+				if (m_bounds[i].pointInside(point))
+					return true;
+			continue;
+		}
+
+		stack[top++] = node.right;
+		stack[top++] = index + 1;
+	}
+	return false;
+}
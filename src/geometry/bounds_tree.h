@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "geometry.h"
+
+
+namespace M2PGeo
+{
+	/**
+	 * Static bounding volume hierarchy over a list of bounds.
+	 * Answers the same point containment query as pointInBounds() in logarithmic
+	 * instead of linear time, for models with many BEVEL/CLIPBEVEL helper brushes.
+	 */
+	class BoundsTree
+	{
+	public:
+		BoundsTree() = default;
+		BoundsTree(const std::vector<Bounds>& bounds);
+
+		bool empty() const { return m_bounds.empty(); }
+		size_t size() const { return m_bounds.size(); }
+
+		/**
+		 * Whether the point lies strictly inside any of the bounds
+		 */
+		bool contains(const Vector3& point) const;
+	private:
+		// Leaves hold a range of m_bounds, inner nodes keep their left child right after themselves
+		struct Node
+		{
+			Bounds bounds;
+			std::uint32_t first = 0;
+			std::uint32_t count = 0;
+			std::uint32_t right = 0;
+		};
+
+		std::vector<Bounds> m_bounds;
+		std::vector<Node> m_nodes;
+
+		void build(std::uint32_t first, std::uint32_t count);
+	};
+}
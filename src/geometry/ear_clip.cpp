@@ -79,46 +79,54 @@ static inline int findOptimalEar(const std::vector<Vertex>& polygon, const std::
     return optimalIndex;
 }
 
-std::vector<Triangle> M2PGeo::earClip(const std::vector<Vertex>& _polygon, const Vector3& normal)
+std::vector<std::array<size_t, 3>> M2PGeo::earClipIndices(const std::vector<Vertex>& _polygon, const Vector3& normal)
 {
     size_t numVertices = _polygon.size();
 
     if (numVertices == 3)
-        return std::vector<Triangle>{Triangle{
-            .flipped = false,
-            .normal = normal,
-            .vertices = {_polygon[0], _polygon[1], _polygon[2]}
-        }};
+        return std::vector<std::array<size_t, 3>>{ { 0, 1, 2 } };
     if (numVertices < 3)
         throw std::runtime_error("Polygon with less than 3 sides");
 
     std::vector<Vertex> polygon(_polygon);  // Make a modifiable copy
+    std::vector<size_t> indices(numVertices);
+    for (size_t i = 0; i < numVertices; ++i)
+        indices[i] = i;
 
-    std::vector<Triangle> triangles;
+    std::vector<std::array<size_t, 3>> triangles;
     triangles.reserve(numVertices - 2);
 
     while (polygon.size() > 3)
     {
         int i = findOptimalEar(polygon, _polygon, normal);
 
-        triangles.push_back(Triangle{
-            .flipped = false,
-            .normal = normal,
-            .vertices = {
-                M2PUtils::getCircular(polygon, i - 1),
-                polygon[i],
-                M2PUtils::getCircular(polygon, i + 1)
-            }
+        triangles.push_back({
+            M2PUtils::getCircular(indices, i - 1),
+            indices[i],
+            M2PUtils::getCircular(indices, i + 1)
         });
 
         polygon.erase(polygon.begin() + i);
+        indices.erase(indices.begin() + i);
     }
 
-    triangles.push_back(Triangle{
-        .flipped = false,
-        .normal = normal,
-        .vertices = {polygon[0], polygon[1], polygon[2]}
-    });
+    triangles.push_back({ indices[0], indices[1], indices[2] });
+
+    return triangles;
+}
+
+std::vector<Triangle> M2PGeo::earClip(const std::vector<Vertex>& _polygon, const Vector3& normal)
+{
+    const std::vector<std::array<size_t, 3>> ears = earClipIndices(_polygon, normal);
+
+    std::vector<Triangle> triangles;
+    triangles.reserve(ears.size());
+    for (const auto& [a, b, c] : ears)
+        triangles.push_back(Triangle{
+            .flipped = false,
+            .normal = normal,
+            .vertices = {_polygon[a], _polygon[b], _polygon[c]}
+        });
 
     return triangles;
 }
@@ -1,10 +1,19 @@
 #pragma once
+#include <array>
 #include "geometry.h"
 
 namespace M2PGeo
 {
 	using Vertex3 = std::tuple<Vertex, Vertex, Vertex>;
 
+	/**
+	 * Triangulates a convex or concave polygon, giving each triangle as indices into the polygon
+	 */
+	std::vector<std::array<size_t, 3>> earClipIndices(
+		const std::vector<Vertex> &_polygon,
+		const Vector3 &normal
+	);
+
 	std::vector<Triangle> earClip(
 		const std::vector<Vertex> &_polygon,
 		const Vector3 &normal
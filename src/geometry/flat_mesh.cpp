@@ -0,0 +1,177 @@
+#include <unordered_map>
+#include "flat_mesh.h"
+
+
+using namespace M2PHalfEdge;
+
+
+FlatMesh::FlatMesh(const Mesh& mesh)
+{
+	const size_t numCoords = mesh.coords.size();
+	const size_t numEdges = mesh.edges.size();
+	const size_t numFaces = mesh.faces.size();
+
+	x.reserve(numCoords); y.reserve(numCoords); z.reserve(numCoords);
+	coordEdges.reserve(numCoords);
+	for (const auto& pCoord : mesh.coords)
+	{
+		x.push_back(pCoord->x);
+		y.push_back(pCoord->y);
+		z.push_back(pCoord->z);
+		coordEdges.push_back(pCoord->edge ? pCoord->edge->index : c_NO_INDEX);
+	}
+
+	edgeOrigins.reserve(numEdges); edgeNexts.reserve(numEdges); edgePrevs.reserve(numEdges);
+	edgeTwins.reserve(numEdges); edgeFaces.reserve(numEdges); edgeFlags.reserve(numEdges);
+	for (const auto& pEdge : mesh.edges)
+	{
+		edgeOrigins.push_back(pEdge->origin->index);
+		edgeNexts.push_back(pEdge->next ? pEdge->next->index : c_NO_INDEX);
+		edgePrevs.push_back(pEdge->prev ? pEdge->prev->index : c_NO_INDEX);
+		edgeTwins.push_back(pEdge->twin ? pEdge->twin->index : c_NO_INDEX);
+		edgeFaces.push_back(pEdge->face ? pEdge->face->index : c_NO_INDEX);
+
+		std::uint8_t flags = 0;
+		if (pEdge->sharp)
+			flags |= EdgeFlags::SHARP;
+		if (pEdge->faceIndices.size() != 1)
+			flags |= EdgeFlags::NON_MANIFOLD;
+		edgeFlags.push_back(flags);
+	}
+
+	std::unordered_map<std::string, std::uint32_t> textureIndices;
+	faceVertices.reserve(numFaces * 3);
+	faceNormals.reserve(numFaces);
+	faceTextures.reserve(numFaces);
+	faceFlipped.reserve(numFaces);
+	for (const auto& pFace : mesh.faces)
+	{
+		for (const Vertex& vertex : pFace->vertices)
+		{
+			faceVertices.push_back(PackedVertex{
+				.position = vertex.position->index,
+				.normal = { vertex.normal.x, vertex.normal.y, vertex.normal.z },
+				.uv = { vertex.uv.x, vertex.uv.y }
+			});
+		}
+		faceNormals.push_back(pFace->normal);
+		faceFlipped.push_back(pFace->flipped);
+
+		auto [it, inserted] = textureIndices.try_emplace(pFace->textureName, static_cast<std::uint32_t>(textureNames.size()));
+		if (inserted)
+			textureNames.push_back(pFace->textureName);
+		faceTextures.push_back(it->second);
+	}
+}
+
+M2PGeo::Vector3 FlatMesh::fullNormal(std::uint32_t face) const
+{
+	return M2PGeo::segmentsCross(
+		position(faceVertices[face * 3].position),
+		position(faceVertices[face * 3 + 1].position),
+		position(faceVertices[face * 3 + 2].position)
+	);
+}
+
+void FlatMesh::applyOffset(const M2PGeo::Vector3& offset)
+{
+	for (FP& value : x) value -= offset.x;
+	for (FP& value : y) value -= offset.y;
+	for (FP& value : z) value -= offset.z;
+}
+
+SmoothEdgeCounts FlatMesh::markSmoothEdges(
+	FP smoothing,
+	const M2PGeo::BoundsTree& alwaysSmooth,
+	const M2PGeo::BoundsTree& neverSmooth)
+{
+	const FP cosThreshold = smoothThresholdCosine(smoothing);
+	const size_t faceCount = numFaces();
+	const size_t edgeCount = numEdges();
+
+	// Unit face normals as struct-of-arrays
+	std::vector<FP> normalX(faceCount), normalY(faceCount), normalZ(faceCount);
+	for (size_t face = 0; face < faceCount; ++face)
+	{
+		const M2PGeo::Vector3 normal = faceNormals[face].normalised();
+		normalX[face] = normal.x;
+		normalY[face] = normal.y;
+		normalZ[face] = normal.z;
+	}
+
+	// Gather each manifold edge pair once
+	std::vector<bool> visitedEdges(edgeCount, false);
+	std::vector<std::uint32_t> pairEdges, pairFacesA, pairFacesB;
+	pairEdges.reserve(edgeCount / 2);
+	pairFacesA.reserve(edgeCount / 2);
+	pairFacesB.reserve(edgeCount / 2);
+	for (std::uint32_t edge = 0; edge < edgeCount; ++edge)
+	{
+		if (visitedEdges[edge])
+			continue;
+
+		visitedEdges[edge] = true;
+
+		if (edgeFlags[edge] & EdgeFlags::NON_MANIFOLD)
+			continue;
+
+		const std::uint32_t twin = edgeTwins[edge];
+		if (edgeFaces[edge] == c_NO_INDEX || twin == c_NO_INDEX || edgeFaces[twin] == c_NO_INDEX)
+			continue;
+
+		visitedEdges[twin] = true;
+		pairEdges.push_back(edge);
+		pairFacesA.push_back(edgeFaces[edge]);
+		pairFacesB.push_back(edgeFaces[twin]);
+	}
+
+	// Branch free classification over contiguous arrays so the compiler can vectorise it
+	const size_t pairCount = pairEdges.size();
+	std::vector<std::uint8_t> soft(pairCount);
+	for (size_t i = 0; i < pairCount; ++i)
+	{
+		const std::uint32_t a = pairFacesA[i];
+		const std::uint32_t b = pairFacesB[i];
+		const FP dot = normalX[a] * normalX[b] + normalY[a] * normalY[b] + normalZ[a] * normalZ[b];
+		soft[i] = dot > cosThreshold;
+	}
+
+	for (size_t i = 0; i < pairCount; ++i)
+	{
+		const std::uint32_t edge = pairEdges[i];
+
+		if (!neverSmooth.empty() || !alwaysSmooth.empty())
+		{
+			const M2PGeo::Vector3 origin = position(edgeOrigins[edge]);
+			const M2PGeo::Vector3 end = position(edgeOrigins[edgeNexts[edge]]);
+
+			if (!neverSmooth.empty()
+				&& neverSmooth.contains(origin)
+				&& neverSmooth.contains(end)
+				)
+			{
+				continue;
+			}
+
+			if (!alwaysSmooth.empty()
+				&& alwaysSmooth.contains(origin)
+				&& alwaysSmooth.contains(end)
+				)
+			{
+				soft[i] = true;
+			}
+		}
+
+		if (soft[i])
+		{
+			edgeFlags[edge] &= ~EdgeFlags::SHARP;
+			edgeFlags[edgeTwins[edge]] &= ~EdgeFlags::SHARP;
+		}
+	}
+
+	SmoothEdgeCounts counts{};
+	for (std::uint8_t flags : edgeFlags)
+		counts.sharp += flags & EdgeFlags::SHARP;
+	counts.soft = edgeCount - counts.sharp;
+	return counts;
+}
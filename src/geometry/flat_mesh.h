@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <limits>
+#include "geometry.h"
+#include "halfedge.h"
+#include "bounds_tree.h"
+
+
+namespace M2PHalfEdge
+{
+	static inline constexpr std::uint32_t c_NO_INDEX = std::numeric_limits<std::uint32_t>::max();
+
+	enum EdgeFlags : std::uint8_t
+	{
+		SHARP = 1,
+		NON_MANIFOLD = 2,
+	};
+
+	/**
+	 * Per-face vertex attributes, stored three to a face in one contiguous array
+	 */
+	struct PackedVertex
+	{
+		std::uint32_t position = c_NO_INDEX;
+		FP normal[3]{};
+		FP uv[2]{};
+	};
+
+	/**
+	 * Index based half-edge mesh stored in flat arrays.
+	 * Built from a finished Mesh, it holds the same topology without per-element
+	 * heap allocations so the smoothing and SMD writing passes walk memory linearly.
+	 */
+	class FlatMesh
+	{
+	public:
+		// Coord positions (struct-of-arrays) and one outgoing edge per coord
+		std::vector<FP> x, y, z;
+		std::vector<std::uint32_t> coordEdges;
+
+		// Half-edges, c_NO_INDEX where the Mesh had a null pointer
+		std::vector<std::uint32_t> edgeOrigins, edgeNexts, edgePrevs, edgeTwins, edgeFaces;
+		std::vector<std::uint8_t> edgeFlags;
+
+		// Faces, textures are indices into textureNames
+		std::vector<PackedVertex> faceVertices;
+		std::vector<M2PGeo::Vector3> faceNormals;
+		std::vector<std::uint32_t> faceTextures;
+		std::vector<std::uint8_t> faceFlipped;
+		std::vector<std::string> textureNames;
+
+		FlatMesh() = default;
+		FlatMesh(const Mesh& mesh);
+
+		size_t numCoords() const { return x.size(); }
+		size_t numEdges() const { return edgeOrigins.size(); }
+		size_t numFaces() const { return faceNormals.size(); }
+
+		M2PGeo::Vector3 position(std::uint32_t coord) const { return { x[coord], y[coord], z[coord] }; }
+		M2PGeo::Vector3 fullNormal(std::uint32_t face) const;
+		bool isSharp(std::uint32_t edge) const { return edgeFlags[edge] & EdgeFlags::SHARP; }
+
+		void applyOffset(const M2PGeo::Vector3& offset);
+
+		/**
+		 * Clears the sharp flag of manifold edges whose faces meet at less than the smoothing angle.
+		 * Compares the cosine of the threshold against dot products of unit face normals.
+		 */
+		SmoothEdgeCounts markSmoothEdges(
+			FP smoothing,
+			const M2PGeo::BoundsTree& alwaysSmooth,
+			const M2PGeo::BoundsTree& neverSmooth
+		);
+	};
+}
@@ -232,7 +232,7 @@ Plane::Plane(const Vector3 planePoints[3], const Texture& texture)
 
 	m_texture = texture;
 }
-Texture Plane::texture() const { return m_texture; }
+const Texture& Plane::texture() const { return m_texture; }
 
 
 Vector3 M2PGeo::segmentsCross(const Vector3& a, const Vector3& b, const Vector3& c)
@@ -281,110 +281,86 @@ Vector3 M2PGeo::geometricCenter(const std::vector<Vertex> &vertices)
 	return sumVertices(vertices) / static_cast<int>(vertices.size());
 }
 
-void M2PGeo::sortVectors(std::vector<Vector3> &vectors, const Vector3 &normal)
+static inline Vector3 positionOf(const Vector3& vector) { return vector; }
+static inline Vector3 positionOf(const Vertex& vertex) { return vertex.coord(); }
+
+// Monotonic stand-in for atan2(y, x) in [0, 4), increasing counter-clockwise
+static inline FP pseudoAngle(FP x, FP y)
 {
-	size_t numVectors = vectors.size();
-	Vector3 center = geometricCenter(vectors);
-	std::vector<Vector3> rest;
-	rest.reserve(numVectors - 1);
-	rest.insert(rest.begin(), vectors.begin() + 1, vectors.end());
-	vectors.erase(vectors.begin() + 1, vectors.end());
-
-	Vector3 currentVect, vectOther;
-	HessianPlane plane;
-	FP dotNormal, angleSmallest;
-	int indexSmallest, numRest;
-	while (vectors.size() < numVectors)
-	{
-		angleSmallest = -1.0f;
-		indexSmallest = -1;
+	const FP sum = std::abs(x) + std::abs(y);
+	if (sum == 0)
+		return 0;
 
-		currentVect = vectors.back();
-		Vector3 planePoints[3]{currentVect, center, center + normal};
-		plane = HessianPlane(planePoints);
+	const FP p = y / sum;
+	if (x < 0)
+		return 2 - p;
+	return y < 0 ? 4 + p : p;
+}
 
-		numRest = static_cast<int>(rest.size());
-		for (int i = 0; i < numRest; ++i)
-		{
-			if (numRest == 1)
-			{
-				indexSmallest = 0;
-				break;
-			}
+/**
+ * Orders the points of a convex polygon counter-clockwise around the normal,
+ * starting from the first point, in one sort by pseudo-angle on the plane's dominant axes.
+ */
+template <typename T>
+static inline void sortCounterClockwise(std::vector<T>& points, const Vector3& normal)
+{
+	const size_t numPoints = points.size();
+	if (numPoints < 3)
+		return;
 
-			vectOther = rest[i];
-			dotNormal = (currentVect - center).normalised().dot((vectOther - center).normalised());
+	Vector3 center = Vector3::zero();
+	for (const T& point : points)
+		center += positionOf(point);
+	center = center / static_cast<int>(numPoints);
 
-			if (plane.pointRelation(vectOther) == PointRelation::INFRONT && dotNormal > angleSmallest)
-			{
-				angleSmallest = dotNormal;
-				indexSmallest = i;
-			}
-		}
-		vectors.push_back(rest[indexSmallest]);
-		rest.erase(rest.begin() + indexSmallest);
-	}
+	// Drop the dominant axis, keeping the remaining two right-handed about the normal
+	const FP ax = std::abs(normal.x), ay = std::abs(normal.y), az = std::abs(normal.z);
+	const int dominant = (ax >= ay && ax >= az) ? 0 : (ay >= az ? 1 : 2);
+	const int u = (dominant + 1) % 3, v = (dominant + 2) % 3;
+	const FP flip = normal.v[dominant] < 0 ? -1.f : 1.f;
 
-	Vector3 sortedPlanePoints[3]{ vectors[0], vectors[1], vectors[2] };
-	Vector3 sortedNormal = planeNormal(sortedPlanePoints);
-	if (normal.dot(sortedNormal) < 0.0f)
+	std::vector<std::pair<FP, size_t>> keys(numPoints);
+	for (size_t i = 0; i < numPoints; ++i)
 	{
-		std::reverse(vectors.begin(), vectors.end());
+		const Vector3 offset = positionOf(points[i]) - center;
+		keys[i] = { pseudoAngle(offset.v[u], flip * offset.v[v]), i };
 	}
-}
 
-void M2PGeo::sortVertices(std::vector<Vertex> &vertices, const Vector3& normal)
-{
-	size_t numVectors = vertices.size();
-	Vector3 center = geometricCenter(vertices);
-	std::vector<Vertex> rest;
-	rest.reserve(numVectors - 1);
-	rest.insert(rest.begin(), vertices.begin() + 1, vertices.end());
-	vertices.erase(vertices.begin() + 1, vertices.end());
-
-	Vector3 currentVect, vectOther;
-	HessianPlane plane;
-	FP dotNormal, angleSmallest;
-	int indexSmallest, numRest;
-	while (vertices.size() < numVectors)
+	const FP startKey = keys[0].first;
+	for (auto& key : keys)
 	{
-		angleSmallest = -1.0f;
-		indexSmallest = -1;
-
-		currentVect = vertices.back().coord();
-		Vector3 planePoints[3]{ currentVect, center, center + normal };
-		plane = HessianPlane(planePoints);
-
-		numRest = static_cast<int>(rest.size());
-		for (int i = 0; i < numRest; ++i)
-		{
-			if (numRest == 1)
-			{
-				indexSmallest = 0;
-				break;
-			}
+		key.first -= startKey;
+		if (key.first < 0)
+			key.first += 4;
+	}
+	keys[0].first = 0;
 
-			vectOther = rest[i].coord();
-			dotNormal = (currentVect - center).normalised().dot((vectOther - center).normalised());
+	std::sort(keys.begin(), keys.end());
 
-			if (plane.pointRelation(vectOther) == PointRelation::INFRONT && dotNormal > angleSmallest)
-			{
-				angleSmallest = dotNormal;
-				indexSmallest = i;
-			}
-		}
-		vertices.push_back(rest[indexSmallest]);
-		rest.erase(rest.begin() + indexSmallest);
-	}
+	std::vector<T> sorted;
+	sorted.reserve(numPoints);
+	for (const auto& key : keys)
+		sorted.push_back(points[key.second]);
+	points = std::move(sorted);
 
-	Vector3 sortedPlanePoints[3]{ vertices[0], vertices[1], vertices[2] };
+	Vector3 sortedPlanePoints[3]{ positionOf(points[0]), positionOf(points[1]), positionOf(points[2]) };
 	Vector3 sortedNormal = planeNormal(sortedPlanePoints);
 	if (normal.dot(sortedNormal) < 0.0f)
 	{
-		std::reverse(vertices.begin(), vertices.end());
+		std::reverse(points.begin(), points.end());
 	}
 }
 
+void M2PGeo::sortVectors(std::vector<Vector3> &vectors, const Vector3 &normal)
+{
+	sortCounterClockwise(vectors, normal);
+}
+
+void M2PGeo::sortVertices(std::vector<Vertex> &vertices, const Vector3& normal)
+{
+	sortCounterClockwise(vertices, normal);
+}
+
 void M2PGeo::averageNormals(GroupedVertices& groupedVertices)
 {
 	for (std::pair<Vertex, std::vector<std::reference_wrapper<Vertex>>> group : groupedVertices)
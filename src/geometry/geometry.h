@@ -5,6 +5,8 @@
 #include <format>
 #include <unordered_map>
 #include <numbers>
+#include <cmath>
+#include <cstdint>
 
 using FP = float;
 
@@ -169,7 +171,7 @@ namespace M2PGeo {
         Vector3 m_planePoints[3];
     public:
         Plane(const Vector3 planePoints[3], const Texture& texture);
-        Texture texture() const;
+        const Texture& texture() const;
     };
 
     FP deg2rad(FP degrees);
@@ -208,11 +210,34 @@ struct std::formatter<M2PGeo::Vector3> : std::formatter<std::string>
 
 namespace std
 {
+    /*
+     * Hashes the vector snapped to the nearest multiple of the merge epsilon, so vectors
+     * equal by operator== except for rounding noise share a bucket without allocating.
+     * Epsilon equality is not transitive, so a pair straddling a cell boundary may still
+     * hash apart, at most one cell from each other.
+     */
     template<> struct hash<M2PGeo::Vector3>
     {
+        static std::uint64_t quantise(FP value) noexcept
+        {
+            return static_cast<std::uint64_t>(std::llround(static_cast<double>(value) / M2PGeo::c_EPSILON_MERGE));
+        }
+
+        static std::uint64_t mix(std::uint64_t h) noexcept
+        {
+            h ^= h >> 30;
+            h *= 0xBF58476D1CE4E5B9ull;
+            h ^= h >> 27;
+            h *= 0x94D049BB133111EBull;
+            return h ^ (h >> 31);
+        }
+
         std::size_t operator()(M2PGeo::Vector3 const& v) const noexcept
         {
-            return std::hash<std::string>{}(std::format("{:.2g} {:.2g} {:.2g}", v.x, v.y, v.z));
+            std::uint64_t h = mix(quantise(v.x));
+            h = mix(h ^ quantise(v.y));
+            h = mix(h ^ quantise(v.z));
+            return static_cast<std::size_t>(h);
         }
     };
 }
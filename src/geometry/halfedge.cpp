@@ -1,10 +1,15 @@
-#include <set>
+#include <algorithm>
 #include <memory>
+#include <cmath>
+#include <numbers>
 #include "halfedge.h"
-#include "logging.h"
+#include "bounds_tree.h"
 
 
-static inline Logging::Logger& logger = Logging::Logger::getLogger("halfedge");
+static inline constexpr size_t c_ARENA_INITIAL_SIZE = 64 * 1024;
+
+// Keeps edges lying exactly on the threshold angle sharp despite rounding in cos()
+static inline constexpr FP c_EPSILON_SMOOTH_COS = static_cast<FP>(1e-6);
 
 using namespace M2PHalfEdge;
 
@@ -15,6 +20,38 @@ M2PGeo::Vector3 Coord::coord() const
 }
 
 
+bool FaceIndexSet::insert(unsigned int index)
+{
+	if (contains(index))
+		return false;
+
+	if (m_spill.empty() && m_size < c_INLINE_CAPACITY)
+	{
+		unsigned int* position = std::lower_bound(m_inline.data(), m_inline.data() + m_size, index);
+		std::copy_backward(position, m_inline.data() + m_size, m_inline.data() + m_size + 1);
+		*position = index;
+		++m_size;
+		return true;
+	}
+
+	if (m_spill.empty())
+		m_spill.assign(m_inline.begin(), m_inline.begin() + m_size);
+
+	m_spill.insert(std::lower_bound(m_spill.begin(), m_spill.end(), index), index);
+	return true;
+}
+
+bool FaceIndexSet::contains(unsigned int index) const
+{
+	return std::binary_search(begin(), end(), index);
+}
+
+bool FaceIndexSet::operator==(const FaceIndexSet& other) const
+{
+	return std::equal(begin(), end(), other.begin(), other.end());
+}
+
+
 bool Edge::operator==(const Edge& rhs) const
 {
 	return origin->coord() == rhs.origin->coord() && next->origin->coord() == rhs.next->origin->coord();
@@ -45,96 +82,183 @@ bool M2PHalfEdge::Face::operator==(const Face& rhs) const
 	return flipped == rhs.flipped;
 }
 
-static bool containsVector3(std::vector<M2PGeo::Vector3> haystack, M2PGeo::Vector3 needle)
+CoordGrid::Cell CoordGrid::cellFor(const M2PGeo::Vector3& point)
 {
-	for (const M2PGeo::Vector3& item : haystack)
-		if (item == needle)
-			return true;
-	return false;
+	return {
+		static_cast<std::int64_t>(std::floor(static_cast<double>(point.x) / M2PGeo::c_EPSILON_MERGE)),
+		static_cast<std::int64_t>(std::floor(static_cast<double>(point.y) / M2PGeo::c_EPSILON_MERGE)),
+		static_cast<std::int64_t>(std::floor(static_cast<double>(point.z) / M2PGeo::c_EPSILON_MERGE))
+	};
 }
 
-void SmoothFan::addFace(Face* face)
+std::size_t CoordGrid::CellHash::operator()(const Cell& cell) const noexcept
 {
-	faces.push_back(face);
-	if (!containsVector3(normals, face->normal))
-	{
-		normals.push_back(face->normal);
-		accumulatedNormal += face->fullNormal();
-	}
+	std::size_t hash = static_cast<std::size_t>(cell[0]) * 73856093u;
+	hash ^= static_cast<std::size_t>(cell[1]) * 19349663u;
+	hash ^= static_cast<std::size_t>(cell[2]) * 83492791u;
+	return hash;
 }
 
-void SmoothFan::applySmooth() const
+void CoordGrid::insert(Coord* coord)
 {
-	for (auto& face : faces)
-	{
-		if (!face)
-			continue;
+	m_cells[cellFor(coord->coord())].push_back(coord);
+}
 
-		for (int i = 0; i < 3; ++i)
-		{
-			if (face->vertices[i].position->index == coordIndex)
+Coord* CoordGrid::find(const M2PGeo::Vector3& point) const
+{
+	const Cell center = cellFor(point);
+	Coord* found = nullptr;
+
+	// Return the lowest indexed match, same as a linear scan over the coords would
+	for (std::int64_t dx = -1; dx <= 1; ++dx)
+		for (std::int64_t dy = -1; dy <= 1; ++dy)
+			for (std::int64_t dz = -1; dz <= 1; ++dz)
 			{
-				face->vertices[i].normal = accumulatedNormal.normalised();
-				break;
+				const auto it = m_cells.find({ center[0] + dx, center[1] + dy, center[2] + dz });
+				if (it == m_cells.end())
+					continue;
+
+				for (Coord* coord : it->second)
+					if ((!found || coord->index < found->index) && coord->coord() == point)
+						found = coord;
 			}
-		}
-	}
+
+	return found;
+}
+
+void* CountingResource::do_allocate(size_t bytes, size_t alignment)
+{
+	++m_allocations;
+	m_bytes += bytes;
+	return m_upstream->allocate(bytes, alignment);
+}
+
+void CountingResource::do_deallocate(void* p, size_t bytes, size_t alignment)
+{
+	m_upstream->deallocate(p, bytes, alignment);
+}
+
+
+Mesh::Mesh(bool useArena) : m_arena(c_ARENA_INITIAL_SIZE, &m_heap), m_resource(useArena ? &m_arena : static_cast<std::pmr::memory_resource*>(&m_heap))
+{}
+
+Mesh::~Mesh()
+{
+	clear();
+}
+
+template <typename T, typename... Args>
+NodePtr<T> Mesh::makeNode(Args&&... args)
+{
+	++m_nodes;
+	std::pmr::polymorphic_allocator<T> allocator{ m_resource };
+	return NodePtr<T>{ allocator.template new_object<T>(std::forward<Args>(args)...), NodeDeleter{ m_resource } };
+}
+
+void Mesh::clear()
+{
+	faces.clear(); faces.shrink_to_fit();
+	edges.clear(); edges.shrink_to_fit();
+	coords.clear(); coords.shrink_to_fit();
+	m_coordGrid.clear();
+	m_edgeMap.clear();
+	m_sourceCoords.clear();
+	m_nodes = 0;
+	m_nonManifoldEdges = 0;
+	m_arena.release();
+}
+
+AllocationStats Mesh::allocationStats() const
+{
+	return { .nodes = m_nodes, .heapAllocations = m_heap.allocations(), .heapBytes = m_heap.bytes() };
 }
 
 Coord* Mesh::addVertex(const M2PGeo::Vertex vertex)
 {
-	for (const auto& coord : coords)
-		if (coord->coord() == vertex.coord())
-			return coord.get();
-	return coords.emplace_back(std::make_unique<Coord>(static_cast<unsigned int>(coords.size()), vertex)).get();
+	if (Coord* coord = m_coordGrid.find(vertex.coord()))
+		return coord;
+
+	Coord* coord = coords.emplace_back(makeNode<Coord>(static_cast<unsigned int>(coords.size()), vertex)).get();
+	m_coordGrid.insert(coord);
+	return coord;
+}
+
+Coord* Mesh::addIndexedVertex(unsigned int sourceIndex, const M2PGeo::Vertex& vertex)
+{
+	// The grid always returns the lowest indexed match, and later coords only get higher indices,
+	// so the coord found the first time stays the one addVertex would find for this position
+	auto [it, inserted] = m_sourceCoords.try_emplace(sourceIndex, nullptr);
+	if (inserted)
+		it->second = addVertex(vertex);
+	return it->second;
+}
+
+std::uint64_t Mesh::edgeKey(unsigned int originIndex, unsigned int endIndex)
+{
+	return (static_cast<std::uint64_t>(originIndex) << 32) | endIndex;
+}
+
+Edge* Mesh::findEdge(unsigned int originIndex, unsigned int endIndex) const
+{
+	const auto it = m_edgeMap.find(edgeKey(originIndex, endIndex));
+	return it != m_edgeMap.end() ? it->second : nullptr;
 }
 
 Edge* Mesh::addEdge(Coord* origin, const Coord* end, Face* face)
 {
-	Edge* edge = nullptr;
-	for (const auto& other : edges)
-		if (other->origin->index == origin->index && other->next->origin->index == end->index)
-		{
-			edge = other.get();
-			break;
-		}
+	Edge* edge = findEdge(origin->index, end->index);
 	if (!edge)
-		edge = edges.emplace_back(std::make_unique<Edge>(static_cast<unsigned int>(edges.size()), origin, face)).get();
+	{
+		edge = edges.emplace_back(makeNode<Edge>(static_cast<unsigned int>(edges.size()), origin, face, m_resource)).get();
+		m_edgeMap.emplace(edgeKey(origin->index, end->index), edge);
+	}
 
-	edge->faceIndices.insert(face->index);
+	if (edge->faceIndices.insert(face->index) && edge->faceIndices.size() == 2)
+		++m_nonManifoldEdges;
 	return edge;
 }
 
 
 void Mesh::findTwins(Edge* edge)
 {
-	const int origin = edge->origin->index;
-	const int end = edge->next->origin->index;
+	Edge* other = findEdge(edge->next->origin->index, edge->origin->index);
+	if (!other)
+		return;
 
-	for (auto& other : edges)
-	{
-		if (other->origin->index == end && other->next->origin->index == origin)
-		{
-			edge->twin = other.get();
-			other->twin = edge;
-			break;
-		}
-	}
+	edge->twin = other;
+	other->twin = edge;
 }
 
 void Mesh::addTriangle(const M2PGeo::Triangle& triangle, const M2PGeo::Texture& texture, bool flipped)
 {
-	const auto& pFace = faces.emplace_back(std::make_unique<Face>(
+	Coord* v0 = addVertex(triangle.vertices[0]);
+	Coord* v1 = addVertex(triangle.vertices[1]);
+	Coord* v2 = addVertex(triangle.vertices[2]);
+	linkTriangle(triangle, texture, flipped, v0, v1, v2);
+}
+
+void Mesh::addTriangle(
+	const M2PGeo::Triangle& triangle,
+	const std::array<unsigned int, 3>& sourceIndices,
+	const M2PGeo::Texture& texture,
+	bool flipped
+)
+{
+	Coord* v0 = addIndexedVertex(sourceIndices[0], triangle.vertices[0]);
+	Coord* v1 = addIndexedVertex(sourceIndices[1], triangle.vertices[1]);
+	Coord* v2 = addIndexedVertex(sourceIndices[2], triangle.vertices[2]);
+	linkTriangle(triangle, texture, flipped, v0, v1, v2);
+}
+
+void Mesh::linkTriangle(const M2PGeo::Triangle& triangle, const M2PGeo::Texture& texture, bool flipped, Coord* v0, Coord* v1, Coord* v2)
+{
+	const auto& pFace = faces.emplace_back(makeNode<Face>(
 		static_cast<unsigned int>(faces.size()),
 		triangle.normal,
 		texture.name,
 		flipped
 	)).get();
 
-	Coord* v0 = addVertex(triangle.vertices[0]);
-	Coord* v1 = addVertex(triangle.vertices[1]);
-	Coord* v2 = addVertex(triangle.vertices[2]);
-	
 	pFace->vertices[0] = Vertex{v0, pFace->normal, triangle.vertices[0].uv};
 	pFace->vertices[1] = Vertex{v1, pFace->normal, triangle.vertices[1].uv};
 	pFace->vertices[2] = Vertex{v2, pFace->normal, triangle.vertices[2].uv};
@@ -152,20 +276,36 @@ void Mesh::addTriangle(const M2PGeo::Triangle& triangle, const M2PGeo::Texture&
 	findTwins(pE2);
 }
 
-void Mesh::markSmoothEdges(
+FP M2PHalfEdge::smoothThresholdCosine(FP smoothing)
+{
+	const FP threshold = M2PGeo::deg2rad(smoothing);
+
+	// Dot products of unit normals lie within [-1, 1]
+	if (threshold <= 0)
+		return 2;
+	if (threshold > std::numbers::pi)
+		return -2;
+
+	return static_cast<FP>(std::cos(threshold)) + c_EPSILON_SMOOTH_COS;
+}
+
+SmoothEdgeCounts Mesh::markSmoothEdges(
 	FP smoothing,
-	const std::vector<M2PGeo::Bounds>& alwaysSmooth,
-	const std::vector<M2PGeo::Bounds>& neverSmooth)
+	const std::vector<M2PGeo::Bounds>& alwaysSmoothBounds,
+	const std::vector<M2PGeo::Bounds>& neverSmoothBounds)
 {
-	FP threshold = M2PGeo::deg2rad(smoothing);
-	std::set<unsigned int> visitedEdges;
+	const FP cosThreshold = smoothThresholdCosine(smoothing);
+	const M2PGeo::BoundsTree alwaysSmooth{ alwaysSmoothBounds };
+	const M2PGeo::BoundsTree neverSmooth{ neverSmoothBounds };
+	std::vector<bool> visitedEdges(edges.size(), false);
+	SmoothEdgeCounts counts{};
 
 	for (auto& edge : edges)
 	{
-		if (visitedEdges.find(edge->index) != visitedEdges.end())
+		if (visitedEdges[edge->index])
 			continue;
 
-		visitedEdges.insert(edge->index);
+		visitedEdges[edge->index] = true;
 
 		if (edge->faceIndices.size() != 1)
 			continue;
@@ -173,20 +313,20 @@ void Mesh::markSmoothEdges(
 		if (!edge->face || !edge->twin || !edge->twin->face)
 			continue;
 
-		visitedEdges.insert(edge->twin->index);
+		visitedEdges[edge->twin->index] = true;
 
 		if (!neverSmooth.empty()
-			&& M2PGeo::pointInBounds(edge->origin->coord(), neverSmooth)
-			&& M2PGeo::pointInBounds(edge->next->origin->coord(), neverSmooth)
+			&& neverSmooth.contains(edge->origin->coord())
+			&& neverSmooth.contains(edge->next->origin->coord())
 			)
 		{
 			continue;
 		}
 
 		if ((!alwaysSmooth.empty()
-			&& M2PGeo::pointInBounds(edge->origin->coord(), alwaysSmooth)
-			&& M2PGeo::pointInBounds(edge->next->origin->coord(), alwaysSmooth))
-			|| edge->face->normal.angle(edge->twin->face->normal) < threshold
+			&& alwaysSmooth.contains(edge->origin->coord())
+			&& alwaysSmooth.contains(edge->next->origin->coord()))
+			|| edge->face->normal.normalised().dot(edge->twin->face->normal.normalised()) > cosThreshold
 			)
 		{
 			edge->sharp = false;
@@ -194,135 +334,8 @@ void Mesh::markSmoothEdges(
 			continue;
 		}
 	}
-}
-
-static inline SmoothFan walkSmoothFan(
-	const Coord& vertex, Edge* currentEdge,
-	std::set<unsigned int>& visitedFaces
-)
-{
-	SmoothFan fan{ vertex.index };
-
-	// If both edges from this vertex are sharp, this fan only contains this face
-	if (currentEdge->sharp && currentEdge->prev && currentEdge->prev->sharp)
-	{
-		visitedFaces.insert(currentEdge->face->index);
-		fan.addFace(currentEdge->face);
-		return fan;
-	}
-
-	Edge* startEdge = currentEdge;
-	bool backwards{ true };
-
-	int g = 0;
-	while (true)
-	{
-		if (g > 100)
-		{
-			logger.debug("Loop detected in %s() @ L%i", __func__, __LINE__);
-			break;
-		}
-		++g;
-
-		if (visitedFaces.contains(currentEdge->face->index))
-		{
-			backwards = false;
-			break;
-		}
-
-		visitedFaces.insert(currentEdge->face->index);
-
-		if (currentEdge->face->normal.dot(startEdge->face->normal) < 0)
-		{
-			if (!currentEdge->twin)
-				break;
-
-			currentEdge = currentEdge->twin->next;
-			continue;
-		}
-
-		fan.addFace(currentEdge->face);
-
-		if (!currentEdge->twin || currentEdge->sharp)
-			break;
-
-		currentEdge = currentEdge->twin->next;
-	}
-
-	if (startEdge->prev == nullptr)
-		throw std::runtime_error("previous was null");
-
-	g = 0;
-	Edge* prevEdge = startEdge->prev->twin;
-	while (backwards && prevEdge && !prevEdge->sharp)
-	{
-		if (g > 100)
-		{
-			logger.debug("Loop detected in %s() @ L%i", __func__, __LINE__);
-			break;
-		}
-		++g;
-
-		if (visitedFaces.contains(prevEdge->face->index))
-			break;
-
-		visitedFaces.insert(prevEdge->face->index);
-
-		if (prevEdge->face->normal.dot(startEdge->face->normal) < 0)
-		{
-			prevEdge = prevEdge->prev->twin;
-			continue;
-		}
-
-		fan.addFace(prevEdge->face);
-
-		if (!prevEdge->prev->twin || prevEdge->prev->twin->sharp)
-			break;
-
-		prevEdge = prevEdge->prev->twin;
-	}
-
-	return fan;
-}
-
-std::vector<SmoothFan> Mesh::getSmoothFansByVertex(const Coord& vertex)
-{
-	std::vector<SmoothFan> fans;
-
-	std::set<unsigned int> visitedFaces;
-
-	Edge* currentEdge = vertex.edge;
-	unsigned int startEdgeIndex = currentEdge->index;
-
-	int g = 0;
-	while (true)
-	{
-		if (g > 100)
-		{
-			logger.debug("Loop detected in %s() @ L%i", __func__, __LINE__);
-			break;
-		}
-		++g;
-
-		if (visitedFaces.contains(currentEdge->face->index))
-		{
-			if (currentEdge->index == startEdgeIndex || !currentEdge->twin)
-				break;
-
-			currentEdge = currentEdge->twin->next;
-			continue;
-		}
-
-		SmoothFan fan = walkSmoothFan(vertex, currentEdge, visitedFaces);
-		fan.applySmooth();
-
-		fans.push_back(fan);
-
-		if (!currentEdge->twin)
-			break;
-
-		currentEdge = currentEdge->twin->next;
-	}
 
-	return fans;
+	for (const auto& edge : edges)
+		++(edge->sharp ? counts.sharp : counts.soft);
+	return counts;
 }
@@ -2,8 +2,10 @@
 
 #include <vector>
 #include <array>
-#include <set>
 #include <memory>
+#include <cstdint>
+#include <unordered_map>
+#include <memory_resource>
 #include "geometry.h"
 
 
@@ -35,6 +37,35 @@ namespace M2PHalfEdge
 		Vertex(Coord* coord, const M2PGeo::Vector3& _normal, const M2PGeo::Vector2& _uv) : position(coord), normal(_normal), uv(_uv) {}
 	};
 
+	/**
+	 * Sorted set of face indices for a half-edge, with room for two kept inline.
+	 * A half-edge shared by two faces is already non-manifold but stays inline,
+	 * only three or more faces spill into heap storage.
+	 */
+	class FaceIndexSet
+	{
+	public:
+		FaceIndexSet(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) : m_spill(resource) {}
+
+		/**
+		 * @return Whether the index was not already in the set
+		 */
+		bool insert(unsigned int index);
+		bool contains(unsigned int index) const;
+		size_t size() const { return m_spill.empty() ? m_size : m_spill.size(); }
+
+		const unsigned int* begin() const { return m_spill.empty() ? m_inline.data() : m_spill.data(); }
+		const unsigned int* end() const { return begin() + size(); }
+
+		bool operator==(const FaceIndexSet& other) const;
+	private:
+		static inline constexpr size_t c_INLINE_CAPACITY = 2;
+
+		std::array<unsigned int, c_INLINE_CAPACITY> m_inline{};
+		std::uint8_t m_size = 0;
+		std::pmr::vector<unsigned int> m_spill;
+	};
+
 	struct Edge
 	{
 		unsigned int index;
@@ -44,13 +75,14 @@ namespace M2PHalfEdge
 		Edge* next = nullptr;
 		Edge* prev = nullptr;
 		bool sharp{ true };
-		std::set<unsigned int> faceIndices;
+		FaceIndexSet faceIndices;
 
 		Edge(
 			unsigned int _index,
 			Coord* _origin,
-			Face* _face
-		) : index(_index), origin(_origin), face(_face) {};
+			Face* _face,
+			std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+		) : index(_index), origin(_origin), face(_face), faceIndices(resource) {};
 
 		bool operator==(const Edge& rhs) const;
 	};
@@ -77,31 +109,119 @@ namespace M2PHalfEdge
 		bool operator==(const Face& rhs) const;
 	};
 
-	struct SmoothFan
+	/**
+	 * Destroys a mesh node and hands its memory back to the resource it came from
+	 */
+	struct NodeDeleter
+	{
+		std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+
+		template <typename T>
+		void operator()(T* node) const { std::pmr::polymorphic_allocator<T>{ resource }.delete_object(node); }
+	};
+
+	template <typename T>
+	using NodePtr = std::unique_ptr<T, NodeDeleter>;
+
+	/**
+	 * Memory resource counting the allocations it passes on to its upstream resource
+	 */
+	class CountingResource : public std::pmr::memory_resource
+	{
+	public:
+		CountingResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource()) : m_upstream(upstream) {}
+
+		size_t allocations() const { return m_allocations; }
+		size_t bytes() const { return m_bytes; }
+	private:
+		std::pmr::memory_resource* m_upstream;
+		size_t m_allocations = 0;
+		size_t m_bytes = 0;
+
+		void* do_allocate(size_t bytes, size_t alignment) override;
+		void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+	};
+
+	/**
+	 * Mesh node count against the heap allocations made for them
+	 */
+	struct AllocationStats
 	{
-		unsigned int coordIndex;
-		M2PGeo::Vector3 accumulatedNormal = M2PGeo::Vector3::zero();
-		std::vector<Face*> faces;
-		std::vector<M2PGeo::Vector3> normals;
+		size_t nodes = 0;
+		size_t heapAllocations = 0;
+		size_t heapBytes = 0;
+	};
+
+	/**
+	 * Number of half-edges left sharp or made soft by markSmoothEdges
+	 */
+	struct SmoothEdgeCounts
+	{
+		size_t sharp = 0;
+		size_t soft = 0;
+	};
+
+	/**
+	 * Cosine of a smoothing threshold in degrees.
+	 * An edge is smooth where the dot product of its unit face normals is greater than this.
+	 */
+	FP smoothThresholdCosine(FP smoothing);
+
+	/**
+	 * Quantised grid over coord positions for welding vertices in expected constant time.
+	 * Cells are c_EPSILON_MERGE wide, so any coord within merge distance of a point
+	 * is found in the 3x3x3 block of cells surrounding it.
+	 */
+	class CoordGrid
+	{
+	public:
+		using Cell = std::array<std::int64_t, 3>;
+
+		void insert(Coord* coord);
+		Coord* find(const M2PGeo::Vector3& point) const;
+		void clear() { m_cells.clear(); }
+
+		static Cell cellFor(const M2PGeo::Vector3& point);
+	private:
+		struct CellHash
+		{
+			std::size_t operator()(const Cell& cell) const noexcept;
+		};
 
-		void addFace(Face* face);
-		void applySmooth() const;
+		std::unordered_map<Cell, std::vector<Coord*>, CellHash> m_cells;
 	};
 
 	class Mesh
 	{
 	public:
-		std::vector<std::unique_ptr<Coord>> coords;
-		std::vector<std::unique_ptr<Edge>> edges;
-		std::vector<std::unique_ptr<Face>> faces;
+		std::vector<NodePtr<Coord>> coords;
+		std::vector<NodePtr<Edge>> edges;
+		std::vector<NodePtr<Face>> faces;
 
-		Mesh() = default;
+		/**
+		 * @param useArena Take all nodes from a monotonic arena released in one go by clear()
+		 */
+		Mesh(bool useArena = true);
 		Mesh(Mesh& other) = delete;
-		~Mesh() = default;
+		~Mesh();
+
+		void clear();
+		AllocationStats allocationStats() const;
+
+		/**
+		 * Number of half-edges shared by more than one face
+		 */
+		size_t nonManifoldEdges() const { return m_nonManifoldEdges; }
 
 
 		Coord* addVertex(const M2PGeo::Vertex _vertex);
+		/**
+		 * Welds a vertex the source file has already indexed only the first time its index is seen
+		 */
+		Coord* addIndexedVertex(unsigned int sourceIndex, const M2PGeo::Vertex& vertex);
 		Edge* addEdge(Coord* origin, const Coord* end, Face* face);
+		Edge* findEdge(unsigned int originIndex, unsigned int endIndex) const;
 
 		void findTwins(Edge* edge);
 
@@ -110,12 +230,35 @@ namespace M2PHalfEdge
 			const M2PGeo::Texture& texture,
 			bool flipped = false
 		);
+		/**
+		 * @param sourceIndices Position indices of the triangle's vertices in the source file
+		 */
+		void addTriangle(
+			const M2PGeo::Triangle& triangle,
+			const std::array<unsigned int, 3>& sourceIndices,
+			const M2PGeo::Texture& texture,
+			bool flipped = false
+		);
 
-		void markSmoothEdges(
+		SmoothEdgeCounts markSmoothEdges(
 			FP smoothing,
 			const std::vector<M2PGeo::Bounds>& alwaysSmooth,
 			const std::vector<M2PGeo::Bounds>& neverSmooth
 		);
-		std::vector<SmoothFan> getSmoothFansByVertex(const Coord& vertex);
+	private:
+		CountingResource m_heap;
+		std::pmr::monotonic_buffer_resource m_arena;
+		std::pmr::memory_resource* m_resource;
+		size_t m_nodes = 0;
+		size_t m_nonManifoldEdges = 0;
+		CoordGrid m_coordGrid;
+		std::unordered_map<std::uint64_t, Edge*> m_edgeMap;
+		std::unordered_map<unsigned int, Coord*> m_sourceCoords;
+
+		template <typename T, typename... Args>
+		NodePtr<T> makeNode(Args&&... args);
+
+		static std::uint64_t edgeKey(unsigned int originIndex, unsigned int endIndex);
+		void linkTriangle(const M2PGeo::Triangle& triangle, const M2PGeo::Texture& texture, bool flipped, Coord* v0, Coord* v1, Coord* v2);
 	};
 }
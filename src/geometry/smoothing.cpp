@@ -0,0 +1,220 @@
+#include <algorithm>
+#include "parallel.h"
+#include "smoothing.h"
+
+
+static inline constexpr std::uint32_t c_COORDS_PER_TASK = 2048;
+/** Coords with up to this many corners compare them directly, more are sorted into cells first */
+static inline constexpr std::uint32_t c_SCAN_CORNERS = 16;
+
+
+using namespace M2PHalfEdge;
+
+
+SmoothingGroups::SmoothingGroups(FlatMesh& mesh) : m_mesh(mesh)
+{
+	const size_t numFaces = mesh.numFaces();
+	const size_t numCorners = numFaces * 3;
+
+	m_faceNormals.reserve(numFaces);
+	for (std::uint32_t face = 0; face < numFaces; ++face)
+		m_faceNormals.push_back(mesh.fullNormal(face));
+
+	// Outgoing half-edge of each corner, only where the edge belongs to that face alone
+	m_cornerEdges.assign(numCorners, c_NO_INDEX);
+	for (std::uint32_t edge = 0; edge < mesh.numEdges(); ++edge)
+	{
+		const std::uint32_t face = mesh.edgeFaces[edge];
+		if (face == c_NO_INDEX || (mesh.edgeFlags[edge] & EdgeFlags::NON_MANIFOLD))
+			continue;
+
+		const std::uint32_t corner = cornerAt(face, mesh.edgeOrigins[edge]);
+		if (corner != c_NO_INDEX)
+			m_cornerEdges[corner] = edge;
+	}
+
+	// Corners grouped by coord, in face order
+	m_coordCornerOffsets.assign(mesh.numCoords() + 1, 0);
+	for (const PackedVertex& vertex : mesh.faceVertices)
+		++m_coordCornerOffsets[vertex.position + 1];
+	for (size_t i = 1; i < m_coordCornerOffsets.size(); ++i)
+		m_coordCornerOffsets[i] += m_coordCornerOffsets[i - 1];
+
+	m_coordCorners.resize(numCorners);
+	std::vector<std::uint32_t> cursors(m_coordCornerOffsets.begin(), m_coordCornerOffsets.end() - 1);
+	for (std::uint32_t corner = 0; corner < numCorners; ++corner)
+		m_coordCorners[cursors[mesh.faceVertices[corner].position]++] = corner;
+
+	m_parents.resize(numCorners);
+	for (std::uint32_t corner = 0; corner < numCorners; ++corner)
+		m_parents[corner] = corner;
+	m_groupNormals.assign(numCorners, M2PGeo::Vector3::zero());
+}
+
+std::uint32_t SmoothingGroups::cornerAt(std::uint32_t face, std::uint32_t coord) const
+{
+	for (std::uint32_t i = 0; i < 3; ++i)
+		if (m_mesh.faceVertices[face * 3 + i].position == coord)
+			return face * 3 + i;
+	return c_NO_INDEX;
+}
+
+std::uint32_t SmoothingGroups::find(std::uint32_t corner)
+{
+	while (m_parents[corner] != corner)
+	{
+		m_parents[corner] = m_parents[m_parents[corner]];
+		corner = m_parents[corner];
+	}
+	return corner;
+}
+
+void SmoothingGroups::unite(std::uint32_t a, std::uint32_t b)
+{
+	a = find(a);
+	b = find(b);
+	if (a == b)
+		return;
+
+	// Lowest corner becomes the root so groups come out the same regardless of edge order
+	if (b < a)
+		std::swap(a, b);
+	m_parents[b] = a;
+}
+
+std::vector<bool> SmoothingGroups::countedCorners(std::uint32_t begin, std::uint32_t end)
+{
+	// Normals in the same merge epsilon wide cell are always equal, so only the first corner
+	// of each cell can count, and only if no earlier corner in a neighbouring cell equals it
+	struct Key
+	{
+		std::uint32_t root;
+		CoordGrid::Cell cell;
+		std::uint32_t order;
+
+		auto operator<=>(const Key& other) const = default;
+	};
+
+	std::vector<Key> keys;
+	keys.reserve(end - begin);
+	for (std::uint32_t i = begin; i < end; ++i)
+	{
+		const std::uint32_t corner = m_coordCorners[i];
+		keys.push_back({ find(corner), CoordGrid::cellFor(m_mesh.faceNormals[corner / 3]), i - begin });
+	}
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<bool> counted(end - begin, false);
+	for (size_t k = 0; k < keys.size(); ++k)
+	{
+		const Key& key = keys[k];
+		if (k > 0 && keys[k - 1].root == key.root && keys[k - 1].cell == key.cell)
+			continue;
+
+		const M2PGeo::Vector3& normal = m_mesh.faceNormals[m_coordCorners[begin + key.order] / 3];
+		bool seen = false;
+		for (std::int64_t dx = -1; dx <= 1 && !seen; ++dx)
+			for (std::int64_t dy = -1; dy <= 1 && !seen; ++dy)
+				for (std::int64_t dz = -1; dz <= 1 && !seen; ++dz)
+				{
+					if (dx == 0 && dy == 0 && dz == 0)
+						continue;
+
+					const CoordGrid::Cell cell{ key.cell[0] + dx, key.cell[1] + dy, key.cell[2] + dz };
+					auto it = std::lower_bound(keys.begin(), keys.end(), Key{ key.root, cell, 0 });
+					for (; !seen && it != keys.end() && it->root == key.root && it->cell == cell && it->order < key.order; ++it)
+						seen = m_mesh.faceNormals[m_coordCorners[begin + it->order] / 3] == normal;
+				}
+
+		counted[key.order] = !seen;
+	}
+	return counted;
+}
+
+size_t SmoothingGroups::smoothCoord(std::uint32_t coord)
+{
+	const std::uint32_t begin = m_coordCornerOffsets[coord];
+	const std::uint32_t end = m_coordCornerOffsets[coord + 1];
+
+	// Every soft edge at the coord is the outgoing edge of one of its corners
+	for (std::uint32_t i = begin; i < end; ++i)
+	{
+		const std::uint32_t corner = m_coordCorners[i];
+		const std::uint32_t edge = m_cornerEdges[corner];
+		if (edge == c_NO_INDEX || m_mesh.isSharp(edge))
+			continue;
+
+		const std::uint32_t twin = m_mesh.edgeTwins[edge];
+		if (twin == c_NO_INDEX || m_mesh.edgeFaces[twin] == c_NO_INDEX)
+			continue;
+
+		// Faces pointing away from each other are never averaged together
+		const std::uint32_t face = corner / 3;
+		const std::uint32_t twinFace = m_mesh.edgeFaces[twin];
+		if (m_mesh.faceNormals[face].dot(m_mesh.faceNormals[twinFace]) < 0)
+			continue;
+
+		const std::uint32_t other = cornerAt(twinFace, coord);
+		if (other != c_NO_INDEX)
+			unite(corner, other);
+	}
+
+	size_t numGroups = 0;
+	for (std::uint32_t i = begin; i < end; ++i)
+	{
+		const std::uint32_t corner = m_coordCorners[i];
+		if (find(corner) == corner)
+			++numGroups;
+	}
+
+	// Coplanar faces of the same group only count once, summed in corner order
+	if (end - begin <= c_SCAN_CORNERS)
+	{
+		for (std::uint32_t i = begin; i < end; ++i)
+		{
+			const std::uint32_t corner = m_coordCorners[i];
+			const std::uint32_t root = find(corner);
+			const M2PGeo::Vector3& normal = m_mesh.faceNormals[corner / 3];
+			bool seen = false;
+			for (std::uint32_t j = begin; j < i && !seen; ++j)
+			{
+				const std::uint32_t previous = m_coordCorners[j];
+				seen = find(previous) == root && m_mesh.faceNormals[previous / 3] == normal;
+			}
+			if (!seen)
+				m_groupNormals[root] += m_faceNormals[corner / 3];
+		}
+	}
+	else
+	{
+		const std::vector<bool> counted = countedCorners(begin, end);
+		for (std::uint32_t i = begin; i < end; ++i)
+		{
+			const std::uint32_t corner = m_coordCorners[i];
+			if (counted[i - begin])
+				m_groupNormals[find(corner)] += m_faceNormals[corner / 3];
+		}
+	}
+
+	for (std::uint32_t i = begin; i < end; ++i)
+	{
+		const std::uint32_t corner = m_coordCorners[i];
+		const M2PGeo::Vector3& sum = m_groupNormals[find(corner)];
+		if (sum.x == 0 && sum.y == 0 && sum.z == 0)
+			continue;
+
+		const M2PGeo::Vector3 normal = sum.normalised();
+		PackedVertex& vertex = m_mesh.faceVertices[corner];
+		vertex.normal[0] = normal.x;
+		vertex.normal[1] = normal.y;
+		vertex.normal[2] = normal.z;
+	}
+
+	return numGroups;
+}
+
+void SmoothingGroups::smoothAll(unsigned int threads)
+{
+	M2PUtils::parallelFor(m_mesh.numCoords(), c_COORDS_PER_TASK, threads,
+		[this](size_t coord) { smoothCoord(static_cast<std::uint32_t>(coord)); });
+}
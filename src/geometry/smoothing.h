@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "geometry.h"
+#include "flat_mesh.h"
+
+
+namespace M2PHalfEdge
+{
+	/**
+	 * Vertex normal smoothing over a FlatMesh using disjoint sets.
+	 * Face corners sharing a coord are unioned across its non-sharp edges, and each
+	 * resulting group takes the sum of its cached area weighted face normals, every
+	 * distinct face normal counted once. No walking around the coord, so there is no
+	 * limit on how many faces may share it.
+	 */
+	class SmoothingGroups
+	{
+	public:
+		SmoothingGroups(FlatMesh& mesh);
+
+		/**
+		 * Smooths the corners around a coord.
+		 * Only touches state belonging to that coord's corners.
+		 * @return Number of smoothing groups at the coord
+		 */
+		size_t smoothCoord(std::uint32_t coord);
+
+		/**
+		 * Smooths every coord, splitting the coords between worker threads.
+		 * Coords never share state, so the result is the same for any thread count.
+		 * @param threads Number of threads to use, 0 uses all hardware threads
+		 */
+		void smoothAll(unsigned int threads = 1);
+	private:
+		FlatMesh& m_mesh;
+		std::vector<M2PGeo::Vector3> m_faceNormals;
+		std::vector<std::uint32_t> m_cornerEdges;
+		std::vector<std::uint32_t> m_coordCornerOffsets;
+		std::vector<std::uint32_t> m_coordCorners;
+		std::vector<std::uint32_t> m_parents;
+		std::vector<M2PGeo::Vector3> m_groupNormals;
+
+		std::uint32_t cornerAt(std::uint32_t face, std::uint32_t coord) const;
+		std::uint32_t find(std::uint32_t corner);
+		/** Which corners of a coord add their face normal, the first of each group and normal */
+		std::vector<bool> countedCorners(std::uint32_t begin, std::uint32_t end);
+		void unite(std::uint32_t a, std::uint32_t b);
+	};
+}
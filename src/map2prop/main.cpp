@@ -26,29 +26,48 @@ int main(int argc, char** argv)
     try
     {
         M2PEntity::BaseReader reader;
+        std::vector<std::filesystem::path> successes;
+        size_t numModels = 0;
+        int res = 0;
 
-        switch (g_config.extension)
+        if (g_config.stream)
         {
-        case M2PConfig::Extension::MAP:
-            reader = M2PFormat::MapReader(g_config.inputFilepath, g_config.outputDir);
-            break;
-        case M2PConfig::Extension::RMF:
-            reader = M2PFormat::RmfReader(g_config.inputFilepath, g_config.outputDir);
-            break;
-        case M2PConfig::Extension::JMF:
-            reader = M2PFormat::JmfReader(g_config.inputFilepath, g_config.outputDir);
-            break;
-        case M2PConfig::Extension::OBJ:
-            reader = M2PFormat::ObjReader(g_config.inputFilepath, g_config.outputDir);
-            break;
-        case M2PConfig::Extension::OL:
-            M2PFormat::OlReader olReader = M2PFormat::OlReader(g_config.inputFilepath, g_config.outputDir);
-            return olReader.process();
+            M2PFormat::MapReader mapReader{ g_config.inputFilepath, g_config.outputDir, true };
+            res = M2PExport::streamModels(mapReader, successes, numModels);
+            reader = std::move(mapReader);
+        }
+        else
+        {
+            switch (g_config.extension)
+            {
+            case M2PConfig::Extension::MAP:
+                reader = M2PFormat::MapReader(g_config.inputFilepath, g_config.outputDir);
+                break;
+            case M2PConfig::Extension::RMF:
+                reader = M2PFormat::RmfReader(g_config.inputFilepath, g_config.outputDir);
+                break;
+            case M2PConfig::Extension::JMF:
+                reader = M2PFormat::JmfReader(g_config.inputFilepath, g_config.outputDir);
+                break;
+            case M2PConfig::Extension::OBJ:
+                reader = M2PFormat::ObjReader(g_config.inputFilepath, g_config.outputDir);
+                break;
+            case M2PConfig::Extension::OL:
+                M2PFormat::OlReader olReader = M2PFormat::OlReader(g_config.inputFilepath, g_config.outputDir);
+                return olReader.process();
+            }
+
+            std::unordered_map<std::string, M2PExport::ModelData> models = M2PExport::prepareModels(reader);
+            numModels = models.size();
+
+            if (!models.empty())
+            {
+                successes.reserve(models.size());
+                res = M2PExport::processModels(models, reader.hasMissingTextures(), successes);
+            }
         }
 
-        std::unordered_map<std::string, M2PExport::ModelData> models = M2PExport::prepareModels(reader);
-
-        if (models.empty())
+        if (numModels == 0)
         {
             if (reader.entities[0]->getKey(M2PExport::c_NOTE_KEY) == M2PExport::c_NOTE_VALUE)
                 logger.info(g_config.input + " was already converted and had no new models to convert");
@@ -59,12 +78,6 @@ int main(int argc, char** argv)
         }
 
 
-        std::vector<std::filesystem::path> successes;
-        successes.reserve(models.size());
-
-        int res = M2PExport::processModels(models, reader.hasMissingTextures(), successes);
-
-
         if (res > 0)
             logger.warning("Something went wrong during compilation. Check logs for more info");
 
@@ -83,7 +96,7 @@ int main(int argc, char** argv)
         }
 
         if (g_config.mapcompile && !res)
-            M2PExport::rewriteMap(reader.entities);
+            M2PExport::rewriteMap(reader);
 
         return res;
     }
@@ -0,0 +1,69 @@
+#include "doctest.h"
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+#include "binutils.h"
+
+using namespace M2PBinUtils;
+
+
+TEST_SUITE("binutils")
+{
+    TEST_CASE("binary cursor typed and string reads")
+    {
+        struct Pair
+        {
+            std::int32_t a;
+            float b;
+        };
+
+        std::string data;
+        const std::int32_t number = -42;
+        const float real = 1.5f;
+        data.append(reinterpret_cast<const char*>(&number), sizeof(number));
+        data.append(reinterpret_cast<const char*>(&real), sizeof(real));
+        data += '\x05';
+        data += std::string("clip\0", 5);
+        data += std::string("wood\0\0\0\0", 8);
+        const std::int32_t length = 3;
+        data.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        data += "abc";
+        const Pair pair{ 7, -2.f };
+        data.append(reinterpret_cast<const char*>(&pair), sizeof(pair));
+
+        BinaryCursor cursor{ data };
+        CHECK(cursor.readInt() == number);
+        CHECK(cursor.readFloat() == real);
+        CHECK(cursor.readLPString() == "clip");
+        CHECK(cursor.readNTString(8) == "wood");
+        CHECK(cursor.readIntLPString() == "abc");
+
+        Pair read{};
+        cursor.read(read);
+        CHECK(read.a == 7);
+        CHECK(read.b == -2.f);
+        CHECK(cursor.atEnd());
+
+        cursor.seek(4);
+        cursor.skip(4);
+        CHECK(cursor.readByte() == 5);
+        CHECK(cursor.offset() == 9);
+        CHECK(cursor.remaining() == data.size() - 9);
+    }
+
+    TEST_CASE("binary cursor reads are bounds checked")
+    {
+        const std::string data("\x02\0\0\0\x10\0\0\0", 8);
+        BinaryCursor cursor{ data };
+
+        CHECK_THROWS_AS(cursor.readNTString(9), std::runtime_error);
+        CHECK(cursor.offset() == 0);
+        CHECK(cursor.readInt() == 2);
+        // Claims a 16 byte string with only 0 bytes left after the length
+        CHECK_THROWS_AS(cursor.readIntLPString(), std::runtime_error);
+        CHECK_THROWS_AS(cursor.skip(1), std::runtime_error);
+        CHECK_THROWS_AS(cursor.seek(9), std::runtime_error);
+        CHECK_NOTHROW(cursor.seek(8));
+        CHECK(cursor.atEnd());
+    }
+}
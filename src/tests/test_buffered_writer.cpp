@@ -0,0 +1,58 @@
+#include "doctest.h"
+#include <string>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include "buffered_writer.h"
+
+using namespace M2PUtils;
+
+
+TEST_SUITE("buffered writer")
+{
+    TEST_CASE("floats are written like std::format")
+    {
+        const float values[]{ 0.f, -0.f, 1.f, -1.5f, 0.1f, 1e-5f, 123456.f, 1234567.f, 3.14159265f, -4096.125f, 1e20f };
+
+        BufferedWriter writer;
+        std::string expected;
+        for (float value : values)
+        {
+            writer.write(value);
+            writer.write(' ');
+            expected += std::format("{:.6g} ", value);
+        }
+        CHECK(writer.str() == expected);
+    }
+
+    TEST_CASE("file writes survive buffer flushes")
+    {
+        const std::filesystem::path filepath = std::filesystem::temp_directory_path() / "m2p_test_writer.txt";
+        std::string expected;
+        {
+            BufferedWriter writer{ filepath, 16 };
+            REQUIRE(writer.isOpen());
+            for (int i = 0; i < 100; ++i)
+            {
+                writer.write("line ");
+                writer.write(static_cast<float>(i) * .5f);
+                writer.write('\n');
+                expected += std::format("line {:.6g}\n", static_cast<float>(i) * .5f);
+            }
+            // Larger than the whole buffer
+            const std::string big(40, 'x');
+            writer.write(big);
+            expected += big;
+            CHECK(writer.flush());
+        }
+
+        std::ifstream file{ filepath };
+        std::stringstream contents;
+        contents << file.rdbuf();
+        file.close();
+        std::filesystem::remove(filepath);
+
+        CHECK(contents.str() == expected);
+    }
+}
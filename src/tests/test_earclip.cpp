@@ -21,5 +21,10 @@ TEST_SUITE("ear_clip")
         CHECK(triangles[1].vertices[0] == B);
         CHECK(triangles[1].vertices[1] == C);
         CHECK(triangles[1].vertices[2] == D);
+
+        const auto indices = earClipIndices(std::vector<Vertex>{A, B, C, D}, Vertex{ 0, 0, 1 });
+        REQUIRE(indices.size() == 2);
+        CHECK(indices[0] == std::array<size_t, 3>{ 3, 0, 1 });
+        CHECK(indices[1] == std::array<size_t, 3>{ 1, 2, 3 });
     }
 }
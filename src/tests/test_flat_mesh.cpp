@@ -0,0 +1,331 @@
+#include "doctest.h"
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include "geometry.h"
+#include "halfedge.h"
+#include "flat_mesh.h"
+#include "smoothing.h"
+
+#pragma warning ( disable: 4305 )
+
+using namespace M2PHalfEdge;
+
+
+static void addTriangle(Mesh& mesh, const M2PGeo::Vertex& a, const M2PGeo::Vertex& b, const M2PGeo::Vertex& c)
+{
+    M2PGeo::Triangle triangle{ .vertices = { a, b, c } };
+    M2PGeo::Vector3 planepoints[3] = { a.coord(), b.coord(), c.coord() };
+    triangle.normal = M2PGeo::planeNormal(planepoints);
+    mesh.addTriangle(triangle, M2PGeo::Texture());
+}
+
+// Closed cylinder with caps fanned around a centre vertex
+static void buildCylinder(Mesh& mesh, int segments, FP radius, FP height)
+{
+    M2PGeo::Vertex bottomCenter{ 0, 0, 0 };
+    M2PGeo::Vertex topCenter{ 0, 0, height };
+
+    for (int i = 0; i < segments; ++i)
+    {
+        FP a0 = static_cast<FP>(2 * std::numbers::pi * i / segments);
+        FP a1 = static_cast<FP>(2 * std::numbers::pi * (i + 1) / segments);
+        M2PGeo::Vertex b0{ radius * std::cos(a0), radius * std::sin(a0), 0 };
+        M2PGeo::Vertex b1{ radius * std::cos(a1), radius * std::sin(a1), 0 };
+        M2PGeo::Vertex t0{ b0.x, b0.y, height };
+        M2PGeo::Vertex t1{ b1.x, b1.y, height };
+
+        addTriangle(mesh, b0, b1, t1);
+        addTriangle(mesh, t1, t0, b0);
+        addTriangle(mesh, topCenter, t0, t1);
+        addTriangle(mesh, bottomCenter, b1, b0);
+    }
+}
+
+// Cone with every side face meeting at the apex and the base fanned around a centre vertex
+static void buildCone(Mesh& mesh, int segments, FP radius, FP height)
+{
+    M2PGeo::Vertex apex{ 0, 0, height };
+    M2PGeo::Vertex baseCenter{ 0, 0, 0 };
+
+    for (int i = 0; i < segments; ++i)
+    {
+        FP a0 = static_cast<FP>(2 * std::numbers::pi * i / segments);
+        FP a1 = static_cast<FP>(2 * std::numbers::pi * (i + 1) / segments);
+        M2PGeo::Vertex b0{ radius * std::cos(a0), radius * std::sin(a0), 0 };
+        M2PGeo::Vertex b1{ radius * std::cos(a1), radius * std::sin(a1), 0 };
+
+        addTriangle(mesh, b0, b1, apex);
+        addTriangle(mesh, baseCenter, b1, b0);
+    }
+}
+
+// Axis aligned cube, two triangles per side
+static void buildCube(Mesh& mesh, FP size)
+{
+    const M2PGeo::Vertex v[8] = {
+        { 0, 0, 0 }, { size, 0, 0 }, { size, size, 0 }, { 0, size, 0 },
+        { 0, 0, size }, { size, 0, size }, { size, size, size }, { 0, size, size },
+    };
+    const int quads[6][4] = {
+        { 0, 3, 2, 1 }, { 4, 5, 6, 7 }, { 0, 1, 5, 4 },
+        { 1, 2, 6, 5 }, { 2, 3, 7, 6 }, { 3, 0, 4, 7 },
+    };
+    for (const auto& quad : quads)
+    {
+        addTriangle(mesh, v[quad[0]], v[quad[1]], v[quad[2]]);
+        addTriangle(mesh, v[quad[2]], v[quad[3]], v[quad[0]]);
+    }
+}
+
+// Caps keep their flat normals and the sides smooth to point straight out from the axis
+static void checkCylinderSmoothing(Mesh& mesh, FP smoothing)
+{
+    FlatMesh flat{ mesh };
+
+    mesh.markSmoothEdges(smoothing, {}, {});
+    flat.markSmoothEdges(smoothing, {}, {});
+    SmoothingGroups{ flat }.smoothAll();
+
+    REQUIRE(flat.numEdges() == mesh.edges.size());
+    REQUIRE(flat.numFaces() == mesh.faces.size());
+
+    for (size_t i = 0; i < mesh.edges.size(); ++i)
+        CHECK(flat.isSharp(static_cast<std::uint32_t>(i)) == mesh.edges[i]->sharp);
+
+    for (std::uint32_t i = 0; i < flat.numFaces(); ++i)
+    {
+        const M2PGeo::Vector3 faceNormal{ flat.faceNormals[i] };
+
+        for (std::uint32_t j = 0; j < 3; ++j)
+        {
+            const PackedVertex& vertex = flat.faceVertices[i * 3 + j];
+            const M2PGeo::Vector3 position = flat.position(vertex.position);
+
+            M2PGeo::Vector3 expected = std::abs(faceNormal.z) > .99
+                ? M2PGeo::Vector3{ 0, 0, faceNormal.z > 0 ? 1.f : -1.f }
+                : M2PGeo::Vector3{ position.x, position.y, 0 }.normalised();
+
+            CHECK(M2PGeo::Vector3{ vertex.normal } == expected);
+        }
+    }
+}
+
+
+TEST_SUITE("flat_mesh")
+{
+    TEST_CASE("flat layout keeps topology")
+    {
+        Mesh mesh;
+        buildCylinder(mesh, 8, 16, 32);
+        FlatMesh flat{ mesh };
+
+        CHECK(flat.numCoords() == mesh.coords.size());
+        CHECK(flat.textureNames.size() == 1);
+
+        for (size_t i = 0; i < mesh.edges.size(); ++i)
+        {
+            const Edge& edge = *mesh.edges[i];
+            CHECK(flat.edgeOrigins[i] == edge.origin->index);
+            CHECK(flat.edgeNexts[i] == edge.next->index);
+            CHECK(flat.edgePrevs[i] == edge.prev->index);
+            CHECK(flat.edgeFaces[i] == edge.face->index);
+            CHECK(flat.edgeTwins[i] == (edge.twin ? edge.twin->index : c_NO_INDEX));
+        }
+    }
+
+    TEST_CASE("smoothing groups on cylinders")
+    {
+        SUBCASE("low poly cylinder")
+        {
+            Mesh mesh;
+            buildCylinder(mesh, 12, 32, 64);
+            checkCylinderSmoothing(mesh, 60);
+        }
+
+        SUBCASE("high poly cylinder")
+        {
+            Mesh mesh;
+            buildCylinder(mesh, 48, 32, 64);
+            checkCylinderSmoothing(mesh, 30);
+        }
+    }
+
+    TEST_CASE("smooth edge counts")
+    {
+        Mesh mesh;
+        buildCube(mesh, 32);
+        REQUIRE(mesh.edges.size() == 36);
+
+        SUBCASE("diagonals only below right angles")
+        {
+            FlatMesh flat{ mesh };
+            SmoothEdgeCounts counts = flat.markSmoothEdges(90, {}, {});
+            CHECK(counts.soft == 12);
+            CHECK(counts.sharp == 24);
+
+            SmoothEdgeCounts meshCounts = mesh.markSmoothEdges(90, {}, {});
+            CHECK(meshCounts.soft == counts.soft);
+            CHECK(meshCounts.sharp == counts.sharp);
+        }
+
+        SUBCASE("everything above right angles")
+        {
+            FlatMesh flat{ mesh };
+            SmoothEdgeCounts counts = flat.markSmoothEdges(91, {}, {});
+            CHECK(counts.soft == 36);
+            CHECK(counts.sharp == 0);
+        }
+
+        SUBCASE("nothing at zero")
+        {
+            FlatMesh flat{ mesh };
+            SmoothEdgeCounts counts = flat.markSmoothEdges(0, {}, {});
+            CHECK(counts.soft == 0);
+            CHECK(counts.sharp == 36);
+        }
+
+        SUBCASE("never smooth bounds")
+        {
+            FlatMesh flat{ mesh };
+            SmoothEdgeCounts counts = flat.markSmoothEdges(91, {}, M2PGeo::BoundsTree{ { { { -1, -1, -1 }, { 33, 33, 33 } } } });
+            CHECK(counts.soft == 0);
+        }
+    }
+
+    TEST_CASE("smoothing groups around high valence coords")
+    {
+        constexpr int segments = 128;
+        Mesh mesh;
+        buildCone(mesh, segments, 32, 64);
+        FlatMesh flat{ mesh };
+        flat.markSmoothEdges(60, {}, {});
+        SmoothingGroups groups{ flat };
+
+        std::uint32_t apex = c_NO_INDEX;
+        std::uint32_t baseCenter = c_NO_INDEX;
+        for (std::uint32_t i = 0; i < flat.numCoords(); ++i)
+        {
+            if (flat.position(i) == M2PGeo::Vector3{ 0, 0, 64 }) apex = i;
+            if (flat.position(i) == M2PGeo::Vector3::zero()) baseCenter = i;
+        }
+        REQUIRE(apex != c_NO_INDEX);
+        REQUIRE(baseCenter != c_NO_INDEX);
+
+        CHECK(groups.smoothCoord(apex) == 1);
+        CHECK(groups.smoothCoord(baseCenter) == 1);
+
+        size_t apexCorners = 0;
+        size_t baseCorners = 0;
+        for (const PackedVertex& vertex : flat.faceVertices)
+        {
+            M2PGeo::Vector3 normal{ vertex.normal };
+            if (vertex.position == apex)
+            {
+                ++apexCorners;
+                CHECK(normal == M2PGeo::Vector3{ 0, 0, 1 });
+            }
+            else if (vertex.position == baseCenter)
+            {
+                ++baseCorners;
+                CHECK(normal == M2PGeo::Vector3{ 0, 0, -1 });
+            }
+        }
+        CHECK(apexCorners == segments);
+        CHECK(baseCorners == segments);
+    }
+
+    TEST_CASE("coplanar faces count once around high valence coords")
+    {
+        // Nearly flat fan, its face normals landing on both sides of merge epsilon cell boundaries
+        constexpr int segments = 64;
+        Mesh mesh;
+        for (int i = 0; i < segments; ++i)
+        {
+            FP a0 = static_cast<FP>(2 * std::numbers::pi * i / segments);
+            FP a1 = static_cast<FP>(2 * std::numbers::pi * (i + 1) / segments);
+            FP z0 = static_cast<FP>(i % 5) * .03f;
+            FP z1 = static_cast<FP>((i + 1) % 5 % segments) * .03f;
+            addTriangle(mesh, M2PGeo::Vertex{ 0, 0, 0 }, M2PGeo::Vertex{ 64 * std::cos(a0), 64 * std::sin(a0), z0 }, M2PGeo::Vertex{ 64 * std::cos(a1), 64 * std::sin(a1), z1 });
+        }
+        FlatMesh flat{ mesh };
+        flat.markSmoothEdges(60, {}, {});
+        SmoothingGroups{ flat }.smoothAll();
+
+        // Every face is in one group at the centre, each distinct normal summed once in face order
+        M2PGeo::Vector3 sum = M2PGeo::Vector3::zero();
+        size_t distinct = 0;
+        for (std::uint32_t face = 0; face < flat.numFaces(); ++face)
+        {
+            bool seen = false;
+            for (std::uint32_t previous = 0; previous < face && !seen; ++previous)
+                seen = flat.faceNormals[previous] == flat.faceNormals[face];
+            if (seen)
+                continue;
+            sum += flat.fullNormal(face);
+            ++distinct;
+        }
+        CHECK(distinct > 1);
+        CHECK(distinct < segments);
+
+        const M2PGeo::Vector3 expected = sum.normalised();
+        for (const PackedVertex& vertex : flat.faceVertices)
+        {
+            if (vertex.position != flat.faceVertices[0].position)
+                continue;
+            CHECK(vertex.normal[0] == expected.x);
+            CHECK(vertex.normal[1] == expected.y);
+            CHECK(vertex.normal[2] == expected.z);
+        }
+    }
+
+    TEST_CASE("smoothing groups split at sharp edges")
+    {
+        Mesh mesh;
+        buildCylinder(mesh, 8, 16, 32);
+        FlatMesh flat{ mesh };
+        flat.markSmoothEdges(60, {}, {});
+        SmoothingGroups groups{ flat };
+
+        // Rim coords have one group for the side and one for the cap
+        for (std::uint32_t i = 0; i < flat.numCoords(); ++i)
+        {
+            const M2PGeo::Vector3 position = flat.position(i);
+            const bool centre = position.x == 0 && position.y == 0;
+            CHECK(groups.smoothCoord(i) == (centre ? 1 : 2));
+        }
+    }
+
+    TEST_CASE("threaded smoothing matches serial smoothing")
+    {
+        Mesh mesh;
+        buildCylinder(mesh, 4096, 512, 64);
+        FlatMesh serial{ mesh };
+        serial.markSmoothEdges(60, {}, {});
+        FlatMesh threaded = serial;
+        REQUIRE(serial.numCoords() > 8192);
+
+        SmoothingGroups{ serial }.smoothAll(1);
+        SmoothingGroups{ threaded }.smoothAll(4);
+
+        REQUIRE(serial.faceVertices.size() == threaded.faceVertices.size());
+        size_t mismatches = 0;
+        for (size_t i = 0; i < serial.faceVertices.size(); ++i)
+            if (std::memcmp(serial.faceVertices[i].normal, threaded.faceVertices[i].normal, sizeof(PackedVertex::normal)) != 0)
+                ++mismatches;
+        CHECK(mismatches == 0);
+    }
+
+    TEST_CASE("apply offset")
+    {
+        Mesh mesh;
+        addTriangle(mesh, { 16, 0, 0 }, { 0, 16, 0 }, { 0, 0, 16 });
+        FlatMesh flat{ mesh };
+
+        flat.applyOffset({ 8, 8, 8 });
+
+        CHECK(flat.position(0) == M2PGeo::Vector3{ 8, -8, -8 });
+        CHECK(flat.position(1) == M2PGeo::Vector3{ -8, 8, -8 });
+        CHECK(flat.position(2) == M2PGeo::Vector3{ -8, -8, 8 });
+    }
+}
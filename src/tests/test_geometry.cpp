@@ -1,12 +1,61 @@
 #include "doctest.h"
 #include <cmath>
+#include <random>
+#include <unordered_set>
+#include <algorithm>
+#include <numbers>
 #include "geometry.h"
+#include "bounds_tree.h"
 
 #pragma warning ( disable: 4305 )
 
 using namespace M2PGeo;
 
 
+// Previous O(n^2) ordering, kept as a reference for the winding convention
+static void referenceSortVertices(std::vector<Vertex>& vertices, const Vector3& normal)
+{
+    size_t numVectors = vertices.size();
+    Vector3 center = geometricCenter(vertices);
+    std::vector<Vertex> rest(vertices.begin() + 1, vertices.end());
+    vertices.erase(vertices.begin() + 1, vertices.end());
+
+    while (vertices.size() < numVectors)
+    {
+        FP angleSmallest = -1.0f;
+        int indexSmallest = -1;
+
+        Vector3 currentVect = vertices.back().coord();
+        Vector3 planePoints[3]{ currentVect, center, center + normal };
+        HessianPlane plane{ planePoints };
+
+        int numRest = static_cast<int>(rest.size());
+        for (int i = 0; i < numRest; ++i)
+        {
+            if (numRest == 1)
+            {
+                indexSmallest = 0;
+                break;
+            }
+
+            Vector3 vectOther = rest[i].coord();
+            FP dotNormal = (currentVect - center).normalised().dot((vectOther - center).normalised());
+            if (plane.pointRelation(vectOther) == PointRelation::INFRONT && dotNormal > angleSmallest)
+            {
+                angleSmallest = dotNormal;
+                indexSmallest = i;
+            }
+        }
+        vertices.push_back(rest[indexSmallest]);
+        rest.erase(rest.begin() + indexSmallest);
+    }
+
+    Vector3 sortedPlanePoints[3]{ vertices[0], vertices[1], vertices[2] };
+    if (normal.dot(planeNormal(sortedPlanePoints)) < 0.0f)
+        std::reverse(vertices.begin(), vertices.end());
+}
+
+
 TEST_SUITE("geometry")
 {
     TEST_CASE("test angle between vectors")
@@ -82,4 +131,137 @@ TEST_SUITE("geometry")
 
         CHECK(vertices == expected);
     }
+
+    TEST_CASE("sort vertices matches previous winding")
+    {
+        std::mt19937 rng{ 99 };
+        std::uniform_real_distribution<FP> unit{ -1, 1 };
+        std::uniform_real_distribution<FP> size{ 8, 256 };
+        std::uniform_int_distribution<int> sides{ 3, 48 };
+
+        for (int polygon = 0; polygon < 500; ++polygon)
+        {
+            Vector3 normal = Vector3{ unit(rng), unit(rng), unit(rng) }.normalised();
+            if (polygon % 5 == 0)
+                normal = Vector3{ 0, 0, polygon % 2 ? 1.f : -1.f };
+
+            // Orthonormal basis on the polygon plane
+            Vector3 tangent = (std::abs(normal.x) < .9f ? Vector3{ 1, 0, 0 } : Vector3{ 0, 1, 0 }).cross(normal).normalised();
+            Vector3 bitangent = normal.cross(tangent);
+            Vector3 center{ size(rng), -size(rng), size(rng) };
+            FP radiusU = size(rng), radiusV = size(rng);
+
+            const int n = sides(rng);
+            std::vector<Vertex> vertices;
+            for (int i = 0; i < n; ++i)
+            {
+                FP angle = static_cast<FP>(2 * std::numbers::pi * i / n);
+                Vector3 point = center + tangent * (radiusU * std::cos(angle)) + bitangent * (radiusV * std::sin(angle));
+                vertices.emplace_back(point.x, point.y, point.z);
+            }
+            std::shuffle(vertices.begin(), vertices.end(), rng);
+
+            std::vector<Vertex> expected = vertices;
+            referenceSortVertices(expected, normal);
+            sortVertices(vertices, normal);
+
+            CAPTURE(polygon);
+            CHECK(vertices == expected);
+        }
+    }
+
+    TEST_CASE("bounds tree matches linear bounds scan")
+    {
+        std::mt19937 rng{ 1234 };
+        std::uniform_real_distribution<FP> position{ -512, 512 };
+        std::uniform_real_distribution<FP> extent{ 1, 64 };
+
+        std::vector<Bounds> bounds;
+        for (int i = 0; i < 500; ++i)
+        {
+            Vector3 min{ position(rng), position(rng), position(rng) };
+            bounds.push_back({ min, min + Vector3{ extent(rng), extent(rng), extent(rng) } });
+        }
+        BoundsTree tree{ bounds };
+        REQUIRE(tree.size() == bounds.size());
+
+        size_t inside = 0;
+        for (int i = 0; i < 5000; ++i)
+        {
+            Vector3 point{ position(rng), position(rng), position(rng) };
+            bool expected = pointInBounds(point, bounds);
+            inside += expected;
+            CHECK(tree.contains(point) == expected);
+        }
+        CHECK(inside > 0);
+
+        SUBCASE("points on a face are outside")
+        {
+            for (const Bounds& b : bounds)
+            {
+                CHECK(tree.contains(b.min) == pointInBounds(b.min, bounds));
+                CHECK(tree.contains(b.max) == pointInBounds(b.max, bounds));
+            }
+        }
+
+        SUBCASE("empty tree")
+        {
+            CHECK_FALSE(BoundsTree{}.contains(Vector3::zero()));
+        }
+    }
+
+    TEST_CASE("vector hash agrees with equality")
+    {
+        std::hash<Vector3> hasher;
+
+        CHECK(hasher(Vector3{ 0.f, 0.f, 0.f }) == hasher(Vector3{ -0.f, -0.f, -0.f }));
+
+        std::mt19937 rng{ 42 };
+        std::uniform_int_distribution<int> lattice{ -4096, 4096 };
+        std::uniform_real_distribution<FP> noise{ -c_EPSILON_MERGE / 4, c_EPSILON_MERGE / 4 };
+        for (int i = 0; i < 10000; ++i)
+        {
+            Vector3 a{ static_cast<FP>(lattice(rng)), static_cast<FP>(lattice(rng)), static_cast<FP>(lattice(rng)) };
+            Vector3 b = a + Vector3{ noise(rng), noise(rng), noise(rng) };
+            REQUIRE(a == b);
+            CHECK(hasher(a) == hasher(b));
+        }
+
+        SUBCASE("coarse formatting no longer merges distinct vectors")
+        {
+            CHECK(Vector3{ 100, 0, 0 } != Vector3{ 149, 0, 0 });
+            CHECK(hasher(Vector3{ 100, 0, 0 }) != hasher(Vector3{ 149, 0, 0 }));
+        }
+
+        SUBCASE("grouped vertices")
+        {
+            std::vector<Vertex> vertices{ { 16, 32, 64 }, { 16.0001f, 32, 64 }, { 16, 32, 63.9999f }, { 100, 0, 0 }, { 149, 0, 0 } };
+            GroupedVertices grouped;
+            for (Vertex& vertex : vertices)
+                grouped[vertex.coord()].push_back(vertex);
+
+            CHECK(grouped.size() == 3);
+            CHECK(grouped[Vector3{ 16, 32, 64 }].size() == 3);
+        }
+    }
+
+    TEST_CASE("vector hash has no collisions on lattices")
+    {
+        std::hash<Vector3> hasher;
+        std::unordered_set<std::size_t> hashes;
+        size_t count = 0;
+
+        // Unit lattice and a lattice at merge epsilon spacing, every point distinct by operator==
+        for (int x = -32; x < 32; ++x)
+            for (int y = -32; y < 32; ++y)
+                for (int z = -32; z < 32; ++z, ++count)
+                    hashes.insert(hasher(Vector3{ static_cast<FP>(x), static_cast<FP>(y), static_cast<FP>(z) }));
+
+        for (int x = 0; x < 64; ++x)
+            for (int y = 0; y < 64; ++y)
+                for (int z = 0; z < 16; ++z, ++count)
+                    hashes.insert(hasher(Vector3{ 512 + x * 2 * c_EPSILON_MERGE, 512 + y * 2 * c_EPSILON_MERGE, 512 + z * 2 * c_EPSILON_MERGE }));
+
+        CHECK(hashes.size() == count);
+    }
 }
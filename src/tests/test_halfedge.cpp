@@ -1,16 +1,217 @@
 #include "doctest.h"
+#include <algorithm>
 #include <array>
 #include "geometry.h"
 #include "halfedge.h"
+#include "flat_mesh.h"
+#include "smoothing.h"
 
 #pragma warning ( disable: 4305 )
 
 using namespace M2PHalfEdge;
 
 
+// Previous linear edge search, kept as a reference for the hashed edge lookup
+static Edge* linearFindEdge(const Mesh& mesh, unsigned int originIndex, unsigned int endIndex)
+{
+    for (const auto& edge : mesh.edges)
+        if (edge->origin->index == originIndex && edge->next->origin->index == endIndex)
+            return edge.get();
+    return nullptr;
+}
+
+
+// Smoothed normals at a coord with the number of corners taking each, in corner order
+static std::vector<std::pair<M2PGeo::Vector3, size_t>> normalsAt(const FlatMesh& flat, std::uint32_t coord)
+{
+    std::vector<std::pair<M2PGeo::Vector3, size_t>> normals;
+    for (const PackedVertex& vertex : flat.faceVertices)
+    {
+        if (vertex.position != coord)
+            continue;
+
+        const M2PGeo::Vector3 normal{ vertex.normal };
+        auto it = std::find_if(normals.begin(), normals.end(), [&normal](const auto& entry) { return entry.first == normal; });
+        if (it == normals.end())
+            normals.emplace_back(normal, 1);
+        else
+            ++it->second;
+    }
+    return normals;
+}
+
+static size_t cornersWithNormal(const std::vector<std::pair<M2PGeo::Vector3, size_t>>& normals, const M2PGeo::Vector3& normal)
+{
+    for (const auto& [other, count] : normals)
+        if (other == normal)
+            return count;
+    return 0;
+}
+
+
 TEST_SUITE("half_edge")
 {
-    TEST_CASE("walk and smooth fans (irregular spike)")
+    TEST_CASE("face index set")
+    {
+        FaceIndexSet set;
+        CHECK(set.size() == 0);
+
+        CHECK(set.insert(7));
+        CHECK_FALSE(set.insert(7));
+        CHECK(set.insert(3));
+        CHECK(set.size() == 2);
+
+        // Third entry spills out of the inline storage
+        CHECK(set.insert(5));
+        CHECK(set.insert(1));
+        CHECK_FALSE(set.insert(5));
+        CHECK(set.size() == 4);
+        CHECK(std::vector<unsigned int>(set.begin(), set.end()) == std::vector<unsigned int>{ 1, 3, 5, 7 });
+        CHECK(set.contains(3));
+        CHECK_FALSE(set.contains(4));
+
+        FaceIndexSet other;
+        for (unsigned int i : { 5u, 1u, 7u, 3u })
+            other.insert(i);
+        CHECK(set == other);
+    }
+
+    TEST_CASE("count non-manifold edges")
+    {
+        Mesh mesh;
+        M2PGeo::Vertex a{ 0, 0, 0 }, b{ 16, 0, 0 }, c{ 0, 16, 0 }, d{ 0, -16, 0 }, e{ 0, 0, 16 };
+        mesh.addTriangle({ .normal = { 0, 0, 1 }, .vertices = { a, b, c } }, M2PGeo::Texture());
+        mesh.addTriangle({ .normal = { 0, 0, -1 }, .vertices = { b, a, d } }, M2PGeo::Texture());
+        CHECK(mesh.nonManifoldEdges() == 0);
+
+        // Reuses the directed edge a-b of the first triangle
+        mesh.addTriangle({ .normal = { 0, -1, 0 }, .vertices = { a, b, e } }, M2PGeo::Texture());
+        CHECK(mesh.nonManifoldEdges() == 1);
+
+        size_t shared = 0;
+        for (const auto& edge : mesh.edges)
+            shared += edge->faceIndices.size() > 1;
+        CHECK(shared == 1);
+
+        mesh.clear();
+        CHECK(mesh.nonManifoldEdges() == 0);
+    }
+
+    TEST_CASE("arena allocation")
+    {
+        auto buildGrid = [](Mesh& mesh, int size)
+        {
+            for (int y = 0; y < size; ++y)
+            {
+                for (int x = 0; x < size; ++x)
+                {
+                    M2PGeo::Vertex a{ static_cast<FP>(x), static_cast<FP>(y), 0 };
+                    M2PGeo::Vertex b{ static_cast<FP>(x + 1), static_cast<FP>(y), 0 };
+                    M2PGeo::Vertex c{ static_cast<FP>(x + 1), static_cast<FP>(y + 1), 0 };
+                    M2PGeo::Vertex d{ static_cast<FP>(x), static_cast<FP>(y + 1), 0 };
+                    mesh.addTriangle({ .normal = { 0, 0, 1 }, .vertices = { a, b, c } }, M2PGeo::Texture());
+                    mesh.addTriangle({ .normal = { 0, 0, 1 }, .vertices = { c, d, a } }, M2PGeo::Texture());
+                }
+            }
+        };
+
+        Mesh arenaMesh;
+        Mesh heapMesh{ false };
+        buildGrid(arenaMesh, 32);
+        buildGrid(heapMesh, 32);
+
+        const AllocationStats arena = arenaMesh.allocationStats();
+        const AllocationStats heap = heapMesh.allocationStats();
+
+        CHECK(arena.nodes == heap.nodes);
+        CHECK(arena.nodes == arenaMesh.coords.size() + arenaMesh.edges.size() + arenaMesh.faces.size());
+        CHECK(heap.heapAllocations >= heap.nodes);
+        CHECK(arena.heapAllocations * 100 < heap.heapAllocations);
+
+        SUBCASE("same topology either way")
+        {
+            REQUIRE(arenaMesh.edges.size() == heapMesh.edges.size());
+            for (size_t i = 0; i < arenaMesh.edges.size(); ++i)
+            {
+                CHECK(arenaMesh.edges[i]->origin->index == heapMesh.edges[i]->origin->index);
+                CHECK(arenaMesh.edges[i]->faceIndices == heapMesh.edges[i]->faceIndices);
+            }
+        }
+
+        SUBCASE("clear releases the arena")
+        {
+            arenaMesh.clear();
+            CHECK(arenaMesh.coords.empty());
+            buildGrid(arenaMesh, 4);
+            CHECK(arenaMesh.faces.size() == 32);
+            CHECK(arenaMesh.allocationStats().nodes == arenaMesh.coords.size() + arenaMesh.edges.size() + arenaMesh.faces.size());
+        }
+    }
+
+    TEST_CASE("weld vertices within merge epsilon")
+    {
+        Mesh mesh;
+        const FP eps = M2PGeo::c_EPSILON_MERGE;
+
+        SUBCASE("neighbouring cells are welded")
+        {
+            // Straddle a cell boundary on every axis
+            Coord* a = mesh.addVertex(M2PGeo::Vertex{ 16 - eps * .25f, 16 - eps * .25f, -eps * .25f });
+            Coord* b = mesh.addVertex(M2PGeo::Vertex{ 16 + eps * .25f, 16 + eps * .25f, eps * .25f });
+            Coord* c = mesh.addVertex(M2PGeo::Vertex{ 16 + eps * 2, 16, 0 });
+
+            CHECK(a == b);
+            CHECK(a != c);
+            CHECK(mesh.coords.size() == 2);
+        }
+
+        SUBCASE("same indices as a linear scan")
+        {
+            std::vector<M2PGeo::Vector3> scanned;
+            unsigned int seed = 12345;
+            auto next = [&seed]() { seed = seed * 1103515245u + 12345u; return static_cast<FP>((seed >> 16) % 64); };
+
+            for (int i = 0; i < 2000; ++i)
+            {
+                M2PGeo::Vector3 point{ next() * .5f, next() * .5f, next() * eps * .5f };
+
+                unsigned int expected = static_cast<unsigned int>(scanned.size());
+                for (unsigned int j = 0; j < scanned.size(); ++j)
+                    if (scanned[j] == point)
+                    {
+                        expected = j;
+                        break;
+                    }
+                if (expected == scanned.size())
+                    scanned.push_back(point);
+
+                CHECK(mesh.addVertex(M2PGeo::Vertex{ point })->index == expected);
+            }
+            CHECK(mesh.coords.size() == scanned.size());
+        }
+    }
+
+    TEST_CASE("indexed vertices weld like unindexed ones")
+    {
+        // Several source indices share each position, like a file that repeats its vertices
+        std::vector<M2PGeo::Vector3> positions;
+        for (int i = 0; i < 300; ++i)
+            positions.emplace_back(static_cast<FP>(i % 97), static_cast<FP>(i % 13) * .5f, 0);
+
+        Mesh welded, indexed;
+        unsigned int seed = 54321;
+        for (int i = 0; i < 3000; ++i)
+        {
+            seed = seed * 1103515245u + 12345u;
+            const unsigned int sourceIndex = (seed >> 16) % positions.size();
+            const M2PGeo::Vertex vertex{ positions[sourceIndex] };
+
+            CHECK(indexed.addIndexedVertex(sourceIndex, vertex)->index == welded.addVertex(vertex)->index);
+        }
+        CHECK(indexed.coords.size() == welded.coords.size());
+    }
+
+    TEST_CASE("smoothing groups (irregular spike)")
     {
         Mesh mesh;
         M2PGeo::Vertex v0{  32,   24, 64 };
@@ -51,25 +252,25 @@ TEST_SUITE("half_edge")
             mesh.addTriangle(triangle, M2PGeo::Texture());
         }
 
-        mesh.markSmoothEdges(60., {}, {
+        const std::vector<M2PGeo::Bounds> neverSmooth{
             M2PGeo::Bounds{ {-64, 16, -8}, {40, 144, 72} },
             M2PGeo::Bounds{ {24, -104, -8}, {104, 32, 72} }
-        });
+        };
+        mesh.markSmoothEdges(60., {}, neverSmooth);
+
+        FlatMesh flat{ mesh };
+        flat.markSmoothEdges(60., {}, neverSmooth);
+        SmoothingGroups groups{ flat };
 
 
         SUBCASE("all bottom faces should have downwards normals")
         {
-            for (auto& pVertex : mesh.coords)
-                mesh.getSmoothFansByVertex(*pVertex);
+            groups.smoothAll();
 
             M2PGeo::Vector3 expected{ 0, 0, -1 };
 
-            for (int i = 8; i < 14; ++i)
-            {
-                const auto& face = mesh.faces[i];
-                for (auto& v : face->vertices)
-                    CHECK(v.normal == expected);
-            }
+            for (std::uint32_t i = 8 * 3; i < 14 * 3; ++i)
+                CHECK(M2PGeo::Vector3{ flat.faceVertices[i].normal } == expected);
         }
 
         SUBCASE("check expected edges are sharp")
@@ -100,56 +301,24 @@ TEST_SUITE("half_edge")
             }
         }
 
-        SUBCASE("check fans at v0")
-        {
-            auto fans = mesh.getSmoothFansByVertex(*mesh.coords[0]);
-
-            CHECK(fans.size() == 3);
-
-            CHECK(fans[0].faces.size() == 4);
-            CHECK(fans[1].faces.size() == 1);
-            CHECK(fans[2].faces.size() == 3);
-
-            M2PGeo::Vector3 expectedNormals[3]{
-                M2PGeo::Vector3{-0.269f, -0.18f,  0.946f}.normalised(),
-                M2PGeo::Vector3{-0.0578f, 0.52f,  0.852f}.normalised(),
-                M2PGeo::Vector3{ 0.482f,  0.155f, 0.862f}.normalised()
-            };
-
-            for (int i = 0; i < 3; ++i)
-                CHECK(fans[i].accumulatedNormal.normalised() == expectedNormals[i]);
-        }
-
-        SUBCASE("start at edge v7-v0")
+        SUBCASE("check groups at v0")
         {
-            for (auto& edge : mesh.edges)
-            {
-                if (edge->origin->coord() == mesh.coords[0]->coord() && edge->next->origin->coord() == v4.coord())
-                {
-                    mesh.coords[0]->edge = edge.get();
-                    break;
-                }
-            }
-
-            auto fans = mesh.getSmoothFansByVertex(*mesh.coords[0]);
+            CHECK(groups.smoothCoord(0) == 3);
 
-            CHECK(fans.size() == 3);
-
-            CHECK(fans[0].faces.size() == 3);
-            CHECK(fans[1].faces.size() == 4);
-            CHECK(fans[2].faces.size() == 1);
+            const auto normals = normalsAt(flat, 0);
+            CHECK(normals.size() == 3);
+            CHECK(cornersWithNormal(normals, M2PGeo::Vector3{ -0.269f, -0.18f, 0.946f }.normalised()) == 4);
+            CHECK(cornersWithNormal(normals, M2PGeo::Vector3{ -0.0578f, 0.52f, 0.852f }.normalised()) == 1);
+            CHECK(cornersWithNormal(normals, M2PGeo::Vector3{ 0.482f, 0.155f, 0.862f }.normalised()) == 3);
         }
 
         SUBCASE("check edge vertex")
         {
-            auto fans = mesh.getSmoothFansByVertex(*mesh.coords[6]);
-
-            CHECK(fans.size() == 2);
-
-            CHECK(fans[0].faces.size() == 3);
-            CHECK(fans[1].faces.size() == 2);
+            CHECK(groups.smoothCoord(6) == 2);
 
-            CHECK(fans[0].accumulatedNormal.normalised() == M2PGeo::Vector3{ 0, 0, -1 });
+            const auto normals = normalsAt(flat, 6);
+            CHECK(normals.size() == 2);
+            CHECK(cornersWithNormal(normals, M2PGeo::Vector3{ 0, 0, -1 }) == 3);
         }
 
     }
@@ -207,9 +376,14 @@ TEST_SUITE("half_edge")
             mesh.addTriangle(triangle, M2PGeo::Texture());
         }
 
-        mesh.markSmoothEdges(60., {}, {
+        const std::vector<M2PGeo::Bounds> neverSmooth{
             M2PGeo::Bounds{{-40, -40, 96}, {40, 40, 136}}
-        });
+        };
+        mesh.markSmoothEdges(60., {}, neverSmooth);
+
+        FlatMesh flat{ mesh };
+        flat.markSmoothEdges(60., {}, neverSmooth);
+        SmoothingGroups groups{ flat };
 
 
         SUBCASE("check expected edges are sharp")
@@ -242,46 +416,37 @@ TEST_SUITE("half_edge")
 
         SUBCASE("check top vertices (open)")
         {
-            std::array<int, 8> topVertices{ 8, 9, 10, 11, 12, 13, 14, 15 };
+            std::array<std::uint32_t, 8> topVertices{ 8, 9, 10, 11, 12, 13, 14, 15 };
             M2PGeo::Vector3 up{ 0, 0, 1 };
 
-            for (int i : topVertices)
+            for (std::uint32_t i : topVertices)
             {
-                auto fans = mesh.getSmoothFansByVertex(*mesh.coords[i]);
-                // We should only have one fan, each with 3 faces, and the normal should not be pointing up
+                // We should only have one group of 3 faces, and the normal should not be pointing up
+                CHECK(groups.smoothCoord(i) == 1);
 
-                CHECK(fans.size() == 1);
-                CHECK(fans[0].faces.size() == 3);
-                CHECK(fans[0].accumulatedNormal.normalised() != up);
+                const auto normals = normalsAt(flat, i);
+                REQUIRE(normals.size() == 1);
+                CHECK(normals[0].second == 3);
+                CHECK(normals[0].first != up);
             }
         }
 
         SUBCASE("check bottom vertices")
         {
-            std::array<int, 8> bottomVertices{ 0, 1, 2, 3, 4, 5, 6, 7 };
+            std::array<std::uint32_t, 8> bottomVertices{ 0, 1, 2, 3, 4, 5, 6, 7 };
             M2PGeo::Vector3 down{ 0, 0, -1 };
 
-            for (int i : bottomVertices)
+            for (std::uint32_t i : bottomVertices)
             {
-                auto fans = mesh.getSmoothFansByVertex(*mesh.coords[i]);
-                // We should have two fans, one for the side and one for the bottom
-
-                CHECK(fans.size() == 2);
-
-                bool hasBottomFan{ false };
-                bool hasSideFan{ false };
-
-                for (const auto& fan : fans)
-                {
-                    if (fan.accumulatedNormal.normalised() == down)
-                        hasBottomFan = true;
-                    else
-                    {
-                        hasSideFan = true;
-                        CHECK(fan.faces.size() == 3);
-                    }
-                }
-                CHECK((hasBottomFan && hasSideFan) == true);
+                // We should have two groups, one for the side and one for the bottom
+                CHECK(groups.smoothCoord(i) == 2);
+
+                const auto normals = normalsAt(flat, i);
+                REQUIRE(normals.size() == 2);
+                CHECK(cornersWithNormal(normals, down) > 0);
+                for (const auto& [normal, count] : normals)
+                    if (normal != down)
+                        CHECK(count == 3);
             }
         }
     }
@@ -386,10 +551,16 @@ TEST_SUITE("half_edge")
 
         mesh.markSmoothEdges(60., {}, {});
 
+        FlatMesh flat{ mesh };
+        flat.markSmoothEdges(60., {}, {});
+        // Only the quad diagonal v0-v2 and the edge v0-v18 are soft around v0,
+        // the three faces between the sharp edges each keep their own normal
+        CHECK(SmoothingGroups{ flat }.smoothCoord(0) == 5);
 
-        auto fans = mesh.getSmoothFansByVertex(*mesh.coords[0]);
-
-        CHECK(fans.size() == 3);
+        const auto normals = normalsAt(flat, 0);
+        CHECK(normals.size() == 5);
+        CHECK(cornersWithNormal(normals, M2PGeo::Vector3{ 1, 0, 0 }) == 2);
+        CHECK(cornersWithNormal(normals, M2PGeo::Vector3{ -2, 0, -1 }.normalised()) == 2);
 
 
         SUBCASE("check expected edges are sharp")
@@ -429,4 +600,42 @@ TEST_SUITE("half_edge")
             }
         }
     }
+
+    TEST_CASE("edge lookup matches a linear search")
+    {
+        constexpr int gridSize = 8;
+
+        Mesh mesh;
+        M2PGeo::Vector3 up{ 0, 0, 1 };
+
+        for (int y = 0; y < gridSize; ++y)
+        {
+            for (int x = 0; x < gridSize; ++x)
+            {
+                M2PGeo::Vertex v00{ x * 16.f, y * 16.f, 0 };
+                M2PGeo::Vertex v10{ (x + 1) * 16.f, y * 16.f, 0 };
+                M2PGeo::Vertex v11{ (x + 1) * 16.f, (y + 1) * 16.f, 0 };
+                M2PGeo::Vertex v01{ x * 16.f, (y + 1) * 16.f, 0 };
+
+                mesh.addTriangle(M2PGeo::Triangle{ .normal = up, .vertices = { v00, v10, v11 } }, M2PGeo::Texture());
+                mesh.addTriangle(M2PGeo::Triangle{ .normal = up, .vertices = { v11, v01, v00 } }, M2PGeo::Texture());
+            }
+        }
+
+        REQUIRE(mesh.faces.size() == gridSize * gridSize * 2);
+
+        // Each added half-edge looks up itself (addEdge) and its reverse (findTwins)
+        size_t found = 0;
+        for (const auto& edge : mesh.edges)
+        {
+            const unsigned int origin = edge->origin->index, end = edge->next->origin->index;
+
+            CHECK(mesh.findEdge(origin, end) == edge.get());
+            CHECK(linearFindEdge(mesh, end, origin) == mesh.findEdge(end, origin));
+            found += mesh.findEdge(end, origin) != nullptr;
+        }
+
+        // Only the border edges have no reverse
+        CHECK(found == mesh.edges.size() - 4 * gridSize);
+    }
 }
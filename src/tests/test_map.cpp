@@ -1,11 +1,176 @@
 #include "doctest.h"
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <numbers>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
 #include "map_format.h"
+#include "export.h"
+#include "config.h"
+#include "utils.h"
+#include "bmp8bpp.h"
 #include "geometry.h"
 
 using namespace M2PGeo;
 using namespace M2PMAP;
 
 
+// Plane facing along the normal at the given distance, built from three points as in a .map file
+static Plane planeFacing(const Vector3& normal, FP distance, const std::string& texture = "wood")
+{
+	const Vector3 axis = std::abs(normal.z) < .9f ? Vector3{ 0, 0, 1 } : Vector3{ 1, 0, 0 };
+	const Vector3 u = normal.cross(axis).normalised() * 64;
+	const Vector3 v = normal.cross(u);
+	const Vector3 origin = normal * distance;
+	Vector3 points[3] = { origin + u, origin, origin + v };
+	return Plane{ points, Texture{ .name = texture } };
+}
+
+// Previous triple plane enumeration, kept as a reference for the clip based builder
+static void referencePlanesToFaces(const std::vector<Plane>& planes, std::vector<M2PEntity::Face>& facesOut)
+{
+	const size_t numPlanes = planes.size();
+	facesOut.assign(numPlanes, {});
+
+	for (size_t i = 0; i < numPlanes; ++i)
+	{
+		for (size_t j = i + 1; j < numPlanes; ++j)
+		{
+			for (size_t k = j + 1; k < numPlanes; ++k)
+			{
+				Vector3 intersection;
+				if (!intersection3Planes(planes[i], planes[j], planes[k], intersection))
+					continue;
+
+				bool outside = false;
+				for (const Plane& plane : planes)
+					outside = outside || plane.pointRelation(intersection) == PointRelation::INFRONT;
+				if (outside)
+					continue;
+
+				for (size_t index : { i, j, k })
+				{
+					std::vector<Vertex>& vertices = facesOut[index].vertices;
+					if (std::find(vertices.begin(), vertices.end(), Vertex{ intersection }) == vertices.end())
+						vertices.emplace_back(intersection);
+					facesOut[index].texture = planes[index].texture();
+					facesOut[index].normal = planes[index].normal();
+				}
+			}
+		}
+	}
+
+	std::erase_if(facesOut, [](const M2PEntity::Face& face) { return face.vertices.size() < 3; });
+	for (M2PEntity::Face& face : facesOut)
+	{
+		sortVertices(face.vertices, face.normal);
+		for (Vertex& vertex : face.vertices)
+			vertex.normal = face.normal;
+	}
+}
+
+static void checkSameFaces(const std::vector<Plane>& planes)
+{
+	std::vector<M2PEntity::Face> expected, actual;
+	referencePlanesToFaces(planes, expected);
+	planesToFaces(planes, actual);
+	REQUIRE_FALSE(expected.empty());
+
+	REQUIRE(actual.size() == expected.size());
+	for (size_t i = 0; i < actual.size(); ++i)
+	{
+		CHECK(actual[i].texture.name == expected[i].texture.name);
+		REQUIRE(actual[i].vertices.size() == expected[i].vertices.size());
+		for (size_t j = 0; j < actual[i].vertices.size(); ++j)
+		{
+			// Bitwise equal, not just within epsilon
+			CHECK(actual[i].vertices[j].x == expected[i].vertices[j].x);
+			CHECK(actual[i].vertices[j].y == expected[i].vertices[j].y);
+			CHECK(actual[i].vertices[j].z == expected[i].vertices[j].z);
+		}
+	}
+}
+
+// Prism with an n sided cross section along z, capped top and bottom
+static std::vector<Plane> cylinderPlanes(int sides, FP radius, FP height)
+{
+	std::vector<Plane> planes;
+	planes.push_back(planeFacing({ 0, 0, 1 }, height, "top"));
+	planes.push_back(planeFacing({ 0, 0, -1 }, 0, "bottom"));
+	for (int i = 0; i < sides; ++i)
+	{
+		const FP angle = static_cast<FP>(2 * std::numbers::pi * i / sides);
+		planes.push_back(planeFacing({ std::cos(angle), std::sin(angle), 0 }, radius));
+	}
+	return planes;
+}
+
+
+// 128x128x16 box brush, textures given in face order top, bottom, west, east, north, south
+static std::string boxBrush(const std::array<std::string, 6>& textures)
+{
+	return "{\n"
+		"( -64 64 16 ) ( 64 64 16 ) ( 64 -64 16 ) " + textures[0] + " [ 1 0 0 0 ] [ 0 -1 0 0 ] 0 1 1\n"
+		"( -64 -64 0 ) ( 64 -64 0 ) ( 64 64 0 ) " + textures[1] + " [ 1 0 0 0 ] [ 0 -1 0 0 ] 0 1 1\n"
+		"( -64 64 16 ) ( -64 -64 16 ) ( -64 -64 0 ) " + textures[2] + " [ 0 1 0 0 ] [ 0 0 -1 0 ] 0 1 1\n"
+		"( 64 64 0 ) ( 64 -64 0 ) ( 64 -64 16 ) " + textures[3] + " [ 0 1 0 0 ] [ 0 0 -1 0 ] 0 1 1\n"
+		"( 64 64 16 ) ( -64 64 16 ) ( -64 64 0 ) " + textures[4] + " [ 1 0 0 0 ] [ 0 0 -1 0 ] 0 1 1\n"
+		"( 64 -64 0 ) ( -64 -64 0 ) ( -64 -64 16 ) " + textures[5] + " [ 1 0 0 0 ] [ 0 0 -1 0 ] 0 1 1\n"
+		"}\n";
+}
+
+static std::string boxBrush(const std::string& texture)
+{
+	return boxBrush({ texture, texture, texture, texture, texture, texture });
+}
+
+struct TestTexture
+{
+	std::string name;
+	int width = 16, height = 16;
+};
+
+// Writes the map into a fresh directory under the temp dir, with a blank bmp next to it for each texture
+static std::filesystem::path writeTestMap(
+	const std::string& dirname, const std::string& filename,
+	const std::string& contents, const std::vector<TestTexture>& textures = {}
+)
+{
+	const std::filesystem::path inputDir = std::filesystem::temp_directory_path() / dirname;
+	std::filesystem::remove_all(inputDir);
+	std::filesystem::create_directories(inputDir);
+
+	std::ofstream file{ inputDir / filename, std::ios::binary };
+	file << contents;
+
+	for (const TestTexture& texture : textures)
+	{
+		M2PBmp::BMP8Bpp bmp{ texture.width, texture.height };
+		bmp.m_data.assign(static_cast<size_t>(texture.width) * texture.height, 0);
+		bmp.m_palette.assign(M2PBmp::c_BMPPALETTESIZE * 4, 0);
+		bmp.save(inputDir / (texture.name + ".bmp"));
+	}
+
+	return inputDir / filename;
+}
+
+// Puts the global config back when it goes out of scope, so a failed assertion can't leak settings into later tests
+class ConfigGuard
+{
+public:
+	ConfigGuard() : m_saved{ M2PConfig::g_config } {}
+	~ConfigGuard() { M2PConfig::g_config = m_saved; }
+	ConfigGuard(const ConfigGuard&) = delete;
+	ConfigGuard& operator=(const ConfigGuard&) = delete;
+
+private:
+	M2PConfig::Config m_saved;
+};
+
+
 TEST_SUITE("map_format")
 {
 	TEST_CASE("test intersection 3 planes")
@@ -31,4 +196,399 @@ TEST_SUITE("map_format")
 		CHECK(intersection3Planes(p1, p2, p3, intersection) == false);
 		CHECK(intersection == expected);
 	}
+
+	TEST_CASE("planes to faces matches triple plane enumeration")
+	{
+		SUBCASE("cube")
+		{
+			std::vector<Plane> planes;
+			for (const Vector3& normal : { Vector3{ 1, 0, 0 }, Vector3{ -1, 0, 0 }, Vector3{ 0, 1, 0 },
+				Vector3{ 0, -1, 0 }, Vector3{ 0, 0, 1 }, Vector3{ 0, 0, -1 } })
+				planes.push_back(planeFacing(normal, 32));
+			checkSameFaces(planes);
+
+			std::vector<M2PEntity::Face> faces;
+			planesToFaces(planes, faces);
+			CHECK(faces.size() == 6);
+			for (const auto& face : faces)
+				CHECK(face.vertices.size() == 4);
+		}
+
+		SUBCASE("cylinders")
+		{
+			for (int sides : { 3, 8, 12, 24, 32, 48, 60 })
+			{
+				CAPTURE(sides);
+				checkSameFaces(cylinderPlanes(sides, 64, 128));
+			}
+		}
+
+		SUBCASE("pyramid apex shared by every side")
+		{
+			for (int sides : { 4, 5, 16 })
+			{
+				std::vector<Plane> planes;
+				planes.push_back(planeFacing({ 0, 0, -1 }, 0));
+				for (int i = 0; i < sides; ++i)
+				{
+					const FP angle = static_cast<FP>(2 * std::numbers::pi * i / sides);
+					const Vector3 normal = Vector3{ std::cos(angle), std::sin(angle), .5f }.normalised();
+					planes.push_back(planeFacing(normal, normal.z * 64));
+				}
+				CAPTURE(sides);
+				checkSameFaces(planes);
+			}
+		}
+
+		SUBCASE("redundant planes")
+		{
+			std::vector<Plane> planes = cylinderPlanes(8, 64, 128);
+			planes.push_back(planeFacing({ 1, 0, 0 }, 100));
+			planes.push_back(planeFacing({ 0, 0, 1 }, 128));
+			checkSameFaces(planes);
+		}
+
+		SUBCASE("random convex brushes")
+		{
+			std::mt19937 rng{ 2024 };
+			std::uniform_real_distribution<FP> unit{ -1, 1 };
+			std::uniform_real_distribution<FP> distance{ 16, 256 };
+			std::uniform_int_distribution<int> count{ 4, 40 };
+
+			for (int brush = 0; brush < 200; ++brush)
+			{
+				std::vector<Plane> planes;
+				for (const Vector3& normal : { Vector3{ 1, 0, 0 }, Vector3{ -1, 0, 0 }, Vector3{ 0, 1, 0 },
+					Vector3{ 0, -1, 0 }, Vector3{ 0, 0, 1 }, Vector3{ 0, 0, -1 } })
+					planes.push_back(planeFacing(normal, 256));
+
+				const int numPlanes = count(rng);
+				for (int i = 0; i < numPlanes; ++i)
+					planes.push_back(planeFacing(Vector3{ unit(rng), unit(rng), unit(rng) }.normalised(), distance(rng)));
+
+				CAPTURE(brush);
+				checkSameFaces(planes);
+			}
+		}
+	}
+
+	TEST_CASE("threaded brush faces match serial planes to faces")
+	{
+		std::mt19937 rng{ 7 };
+		std::uniform_real_distribution<FP> unit{ -1, 1 };
+		std::uniform_real_distribution<FP> distance{ 16, 256 };
+		std::uniform_int_distribution<int> count{ 0, 24 };
+
+		std::vector<M2PEntity::Brush> brushes(300);
+		std::vector<BrushPlanes> pending;
+		for (M2PEntity::Brush& brush : brushes)
+		{
+			std::vector<Plane> planes;
+			for (const Vector3& normal : { Vector3{ 1, 0, 0 }, Vector3{ -1, 0, 0 }, Vector3{ 0, 1, 0 },
+				Vector3{ 0, -1, 0 }, Vector3{ 0, 0, 1 }, Vector3{ 0, 0, -1 } })
+				planes.push_back(planeFacing(normal, distance(rng)));
+
+			const int numPlanes = count(rng);
+			for (int i = 0; i < numPlanes; ++i)
+				planes.push_back(planeFacing(Vector3{ unit(rng), unit(rng), unit(rng) }.normalised(), distance(rng)));
+			pending.push_back({ &brush, std::move(planes) });
+		}
+
+		buildBrushFaces(pending, 4);
+
+		for (size_t i = 0; i < brushes.size(); ++i)
+		{
+			std::vector<M2PEntity::Face> expected;
+			planesToFaces(pending[i].planes, expected);
+			const std::vector<M2PEntity::Face>& actual = brushes[i].faces;
+
+			CAPTURE(i);
+			REQUIRE(actual.size() == expected.size());
+			for (size_t j = 0; j < actual.size(); ++j)
+			{
+				REQUIRE(actual[j].vertices.size() == expected[j].vertices.size());
+				for (size_t k = 0; k < actual[j].vertices.size(); ++k)
+				{
+					const Vertex& a = actual[j].vertices[k];
+					const Vertex& b = expected[j].vertices[k];
+					CHECK((a.x == b.x && a.y == b.y && a.z == b.z));
+				}
+			}
+		}
+	}
+
+	TEST_CASE("map reader keeps raw face lines")
+	{
+		const std::string faces[6] = {
+			"( -64 64 16 ) ( 64 64 16 ) ( 64 -64 16 ) clip [ 1 0 0 0 ] [ 0 -1 0 0 ] 0 1 1\r\n",
+			"( -64 -64 0 ) ( 64 -64 0 ) ( 64 64 0 ) clip [ 1 0 0 0 ] [ 0 -1 0 0 ] 0 1 1\r\n",
+			"( -64 64 16 ) ( -64 -64 16 ) ( -64 -64 0 ) clip [ 0 1 0 0 ] [ 0 0 -1 0 ] 0 1 1\r\n",
+			"( 64 64 0 ) ( 64 -64 0 ) ( 64 -64 16 ) clip [ 0 1 0 0 ] [ 0 0 -1 0 ] 0 1 1\r\n",
+			"( 64 64 16 ) ( -64 64 16 ) ( -64 64 0 ) clip [ 1 0 0 0 ] [ 0 0 -1 0 ] 0 1 1\r\n",
+			"( 64 -64 0 ) ( -64 -64 0 ) ( -64 -64 16 ) clip [ 1 0 0 0 ] [ 0 0 -1 0 ] .5 1.25 -1e1\r\n",
+		};
+		const std::filesystem::path filepath = std::filesystem::temp_directory_path() / "m2p_test_reader.map";
+		{
+			std::ofstream file{ filepath, std::ios::binary };
+			file << "// leading comment\r\n{\r\n\"classname\" \"worldspawn\"\r\n\"wad\" \"\"\r\n{\r\n";
+			file << faces[0] << faces[1] << faces[2] << "// comment between faces\r\n" << faces[3] << faces[4] << faces[5];
+			file << "}\r\n}\r\n{\r\n\"classname\" \"info_null\"\r\n}";
+		}
+
+		M2PFormat::MapReader reader{ filepath, std::filesystem::temp_directory_path() };
+		std::filesystem::remove(filepath);
+
+		REQUIRE(reader.entities.size() == 2);
+		const M2PEntity::Entity& worldspawn = *reader.entities[0];
+		CHECK(worldspawn.classname == "worldspawn");
+		CHECK(worldspawn.getKey("wad") == "");
+		CHECK(reader.entities[1]->classname == "info_null");
+
+		REQUIRE(worldspawn.brushes.size() == 1);
+		const M2PEntity::Brush& brush = *worldspawn.brushes[0];
+		CHECK(brush.faces.size() == 6);
+		const M2PGeo::Texture& texture = brush.faces.back().texture;
+		CHECK(texture.angle == .5f);
+		CHECK(texture.scalex == 1.25f);
+		CHECK(texture.scaley == -10.f);
+
+		std::string expected;
+		for (const std::string& face : faces)
+			expected += face;
+#ifdef _WIN32
+		std::erase(expected, '\r');
+#endif
+		CHECK(brush.getRaw() == expected);
+
+		// Raw text is kept as offsets, so it survives the mapping being let go of
+		reader.source->detach();
+		CHECK(brush.getRaw() == expected);
+	}
+
+	TEST_CASE("map reader accepts a leading plus sign")
+	{
+		std::string brush = boxBrush("clip");
+		M2PUtils::replaceToken(brush, "( 64 64 16 ) ( -64 64 16 ) ( -64 64 0 ) clip [ 1 0 0 0 ] [ 0 0 -1 0 ] 0 1 1",
+			"( +64 +64 +16 ) ( -64 64 16 ) ( -64 64 0 ) clip [ 1 0 0 +8 ] [ 0 0 -1 0 ] +.5 +1 1");
+		const std::filesystem::path filepath = writeTestMap("m2p_test_plus", "plus.map",
+			"{\n\"classname\" \"worldspawn\"\n" + brush + "}\n");
+
+		M2PFormat::MapReader reader{ filepath, std::filesystem::temp_directory_path() };
+		std::filesystem::remove_all(filepath.parent_path());
+
+		REQUIRE(reader.entities.size() == 1);
+		REQUIRE(reader.entities[0]->brushes.size() == 1);
+		const std::vector<M2PEntity::Face>& faces = reader.entities[0]->brushes[0]->faces;
+		REQUIRE(faces.size() == 6);
+
+		const auto north = std::find_if(faces.begin(), faces.end(), [](const M2PEntity::Face& face) { return face.texture.angle != 0; });
+		REQUIRE(north != faces.end());
+		CHECK(north->normal == Vector3{ 0, 1, 0 });
+		CHECK(north->texture.shiftx == 8.f);
+		CHECK(north->texture.angle == .5f);
+		CHECK(north->texture.scalex == 1.f);
+	}
+
+	TEST_CASE("map compile only decodes enabled func_map2prop brushes")
+	{
+		// Textures missing from every wad would be fatal if they were resolved
+		const std::filesystem::path filepath = writeTestMap("m2p_test_mapcompile", "mapcompile.map",
+			"{\n\"classname\" \"worldspawn\"\n" + boxBrush("missing_world") + "}\n"
+			"{\n\"classname\" \"func_map2prop\"\n\"spawnflags\" \"1\"\n" + boxBrush("missing_disabled") + "}\n"
+			"{\n\"classname\" \"func_map2prop\"\n" + boxBrush("clip") + "}\n"
+		);
+
+		ConfigGuard guard;
+		M2PConfig::g_config.mapcompile = true;
+		M2PFormat::MapReader reader{ filepath, std::filesystem::temp_directory_path() };
+		std::filesystem::remove_all(filepath.parent_path());
+
+		REQUIRE(reader.entities.size() == 3);
+		for (const auto& entity : reader.entities)
+			REQUIRE(entity->brushes.size() == 1);
+
+		const M2PEntity::Brush& world = *reader.entities[0]->brushes[0];
+		CHECK(world.faces.empty());
+		CHECK(world.getRaw().find("missing_world") != std::string::npos);
+		CHECK(reader.entities[1]->brushes[0]->faces.empty());
+		CHECK(reader.entities[2]->brushes[0]->faces.size() == 6);
+	}
+
+	TEST_CASE("streamed entities match reading the whole map")
+	{
+		const std::string box = boxBrush("clip");
+		std::string contents = "{\n\"classname\" \"worldspawn\"\n" + box + box + "}\n";
+		for (int i = 0; i < 4; ++i)
+			contents += "{\n\"classname\" \"func_map2prop\"\n\"outname\" \"prop" + std::to_string(i) + "\"\n" + box + "}\n";
+		const std::filesystem::path filepath = writeTestMap("m2p_test_stream", "stream.map", contents);
+
+		M2PFormat::MapReader whole{ filepath, std::filesystem::temp_directory_path() };
+		M2PFormat::MapReader streamed{ filepath, std::filesystem::temp_directory_path(), true };
+		CHECK(streamed.entities.empty());
+
+		size_t count = 0;
+		while (M2PEntity::Entity* entity = streamed.readNextEntity())
+		{
+			REQUIRE(count < whole.entities.size());
+			const M2PEntity::Entity& expected = *whole.entities[count];
+			CHECK(entity == streamed.entities.back().get());
+			CHECK(entity->keyvalues == expected.keyvalues);
+			REQUIRE(entity->brushes.size() == expected.brushes.size());
+			for (size_t i = 0; i < expected.brushes.size(); ++i)
+			{
+				CHECK(entity->brushes[i]->faces.size() == expected.brushes[i]->faces.size());
+				CHECK(entity->brushes[i]->getRaw() == expected.brushes[i]->getRaw());
+			}
+			++count;
+		}
+		std::filesystem::remove_all(filepath.parent_path());
+
+		CHECK(count == 5);
+		CHECK(count == whole.entities.size());
+	}
+
+	TEST_CASE("streamed map compile still generates clip brushes")
+	{
+		const std::filesystem::path filepath = writeTestMap("m2p_test_stream_clip", "clip.map",
+			"{\n\"classname\" \"worldspawn\"\n}\n"
+			"{\n\"classname\" \"func_map2prop\"\n\"clip_type\" \"1\"\n" + boxBrush("m2p_test_clip") + "}\n",
+			{ { "m2p_test_clip" } }
+		);
+		const std::filesystem::path inputDir = filepath.parent_path();
+
+		{
+			ConfigGuard guard;
+			M2PConfig::g_config.inputFilepath = filepath;
+			M2PConfig::g_config.inputDir = inputDir;
+			M2PConfig::g_config.outputDir = inputDir / "out";
+			M2PConfig::g_config.mapcompile = true;
+			M2PConfig::g_config.autocompile = false;
+
+			M2PFormat::MapReader reader{ filepath, M2PConfig::g_config.outputDir, true };
+			std::vector<std::filesystem::path> successes;
+			size_t numModels = 0;
+			CHECK(M2PExport::streamModels(reader, successes, numModels) == 0);
+			CHECK(numModels == 1);
+			M2PExport::rewriteMap(reader);
+		}
+
+		std::ifstream file{ filepath };
+		std::stringstream contents;
+		contents << file.rdbuf();
+		file.close();
+		std::filesystem::remove_all(inputDir);
+
+		// The box clip spans the faces freed after meshing
+		CHECK(contents.str().find("\"classname\" \"func_detail\"") != std::string::npos);
+		CHECK(contents.str().find("( 64 64 16 ) ( 64 64 ") != std::string::npos);
+		CHECK(contents.str().find("m2p_test_clip") == std::string::npos);
+	}
+
+	TEST_CASE("streaming without map compile only keeps worldspawn")
+	{
+		const std::filesystem::path filepath = writeTestMap("m2p_test_stream_world", "world.map",
+			"{\n\"classname\" \"worldspawn\"\n\"wad\" \"\"\n" + boxBrush("m2p_test_world") + "}\n"
+			"{\n\"classname\" \"func_map2prop\"\n" + boxBrush("m2p_test_world") + "}\n",
+			{ { "m2p_test_world" } }
+		);
+		const std::filesystem::path inputDir = filepath.parent_path();
+
+		ConfigGuard guard;
+		M2PConfig::g_config.inputFilepath = filepath;
+		M2PConfig::g_config.inputDir = inputDir;
+		M2PConfig::g_config.outputDir = inputDir / "out";
+		M2PConfig::g_config.autocompile = false;
+
+		M2PFormat::MapReader reader{ filepath, M2PConfig::g_config.outputDir, true };
+		std::vector<std::filesystem::path> successes;
+		size_t numModels = 0;
+		CHECK(M2PExport::streamModels(reader, successes, numModels) == 0);
+		std::filesystem::remove_all(inputDir);
+
+		CHECK(numModels == 1);
+		REQUIRE(reader.entities.size() == 1);
+		CHECK(reader.entities[0]->getKey("wad") == "");
+		REQUIRE(reader.entities[0]->brushes.size() == 1);
+		CHECK(reader.entities[0]->brushes[0]->faces.empty());
+	}
+
+	TEST_CASE("streamed map compile names models like reading the whole map")
+	{
+		// Unnamed props share a model, duplicate and generated outnames get renamed
+		std::string contents = "{\n\"classname\" \"worldspawn\"\n}\n";
+		for (const char* outname : { "", "prop", "", "prop", "names_0", "", "prop" })
+		{
+			contents += "{\n\"classname\" \"func_map2prop\"\n";
+			if (*outname)
+				contents += std::string("\"outname\" \"") + outname + "\"\n";
+			contents += boxBrush("m2p_test_name") + "}\n";
+		}
+		const std::filesystem::path filepath = writeTestMap("m2p_test_stream_names", "names.map", contents, { { "m2p_test_name" } });
+		const std::filesystem::path inputDir = filepath.parent_path();
+
+		ConfigGuard guard;
+		M2PConfig::g_config.inputFilepath = filepath;
+		M2PConfig::g_config.inputDir = inputDir;
+		M2PConfig::g_config.outputDir = inputDir / "out";
+		M2PConfig::g_config.mapcompile = true;
+		M2PConfig::g_config.autocompile = false;
+		M2PFormat::MapReader whole{ filepath, M2PConfig::g_config.outputDir };
+		const auto models = M2PExport::prepareModels(whole);
+
+		M2PFormat::MapReader streamed{ filepath, M2PConfig::g_config.outputDir, true };
+		std::vector<std::filesystem::path> successes;
+		size_t numModels = 0;
+		CHECK(M2PExport::streamModels(streamed, successes, numModels) == 0);
+		std::filesystem::remove_all(inputDir);
+
+		CHECK(numModels == models.size());
+		CHECK(models.contains("names_0"));
+		REQUIRE(streamed.entities.size() == whole.entities.size());
+		for (size_t i = 0; i < whole.entities.size(); ++i)
+			CHECK(streamed.entities[i]->getKey("model") == whole.entities[i]->getKey("model"));
+		CHECK(whole.entities[1]->getKey("model") == whole.entities[3]->getKey("model"));
+	}
+
+	TEST_CASE("map reader resolves each texture once after parsing")
+	{
+		// Only found in the input directory, so both get copied over
+		const std::filesystem::path filepath = writeTestMap("m2p_test_textures", "textures.map",
+			"{\n\"classname\" \"worldspawn\"\n"
+			+ boxBrush({ "m2p_test_top", "m2p_test_side", "m2p_test_side", "M2P_TEST_SIDE", "clip", "m2p_test_top" })
+			+ "}\n",
+			{ { "m2p_test_top", 32, 64 }, { "m2p_test_side", 128, 16 } }
+		);
+		const std::filesystem::path inputDir = filepath.parent_path();
+		const std::filesystem::path outputDir = inputDir / "out";
+
+		ConfigGuard guard;
+		M2PConfig::g_config.inputDir = inputDir;
+		M2PConfig::g_config.outputDir = outputDir;
+		M2PConfig::g_config.threads = 4;
+		M2PFormat::MapReader reader{ filepath, outputDir };
+
+		CHECK(std::filesystem::exists(outputDir / "m2p_test_top.bmp"));
+		CHECK(std::filesystem::exists(outputDir / "m2p_test_side.bmp"));
+		std::filesystem::remove_all(inputDir);
+
+		REQUIRE(reader.entities.size() == 1);
+		REQUIRE(reader.entities[0]->brushes.size() == 1);
+		const std::vector<M2PEntity::Face>& faces = reader.entities[0]->brushes[0]->faces;
+		REQUIRE(faces.size() == 6);
+		for (const M2PEntity::Face& face : faces)
+		{
+			const std::string name = M2PUtils::toLowerCase(face.texture.name);
+			const int width = name == "m2p_test_top" ? 32 : name == "m2p_test_side" ? 128 : 16;
+			const int height = name == "m2p_test_top" ? 64 : 16;
+			CHECK(face.texture.width == width);
+			CHECK(face.texture.height == height);
+
+			for (const Vertex& vertex : face.vertices)
+			{
+				const Vector2 uv = face.texture.uvForPoint(vertex);
+				CHECK(vertex.uv.x == uv.x);
+				CHECK(vertex.uv.y == uv.y);
+			}
+		}
+	}
 }
@@ -0,0 +1,127 @@
+#include "doctest.h"
+#include <string>
+#include <format>
+#include <fstream>
+#include <filesystem>
+#include "obj_format.h"
+#include "config.h"
+
+
+TEST_SUITE("obj")
+{
+	static M2PFormat::ObjReader readObj(const std::string& text, int threads = 1)
+	{
+		const std::filesystem::path filepath = std::filesystem::temp_directory_path() / "m2p_test.obj";
+		{
+			std::ofstream file{ filepath, std::ios::binary };
+			file << text;
+		}
+
+		M2PConfig::g_config.threads = threads;
+		M2PFormat::ObjReader reader{ filepath, std::filesystem::temp_directory_path() };
+		M2PConfig::g_config.threads = 1;
+		std::filesystem::remove(filepath);
+		return reader;
+	}
+
+	TEST_CASE("obj reader follows the object, group and material blocks")
+	{
+		// Tool textures resolve without any files
+		const std::string text =
+			"# Exported by J.A.C.K\r\n"
+			"mtllib test.mtl\r\n"
+			"v 0 0 0\r\n"
+			"v 64 0 0\r\n"
+			"v 64 64 0\r\n"
+			"vt 0 0 0\r\n"
+			"vt 1 -0.5 0\r\n"
+			"vn 0 0 1\r\n"
+			"o entity0 (func_map2prop)\r\n"
+			"s off\r\n"
+			"g brush0\r\n"
+			"usemtl clip\r\n"
+			"f 1/1/1 2/2/1 3/1/1\r\n"
+			"usemtl origin\r\n"
+			"f 3/1/1 2/2/1 1/1/1\r\n"
+			"f 1/2/1 2/2/1 3/2/1\r\n"
+			"\r\n"
+			"g brush1\r\n"
+			"s 1\r\n"
+			"usemtl clip\r\n"      // Not part of brush1, the s line ended its group
+			"f 1/1/1 2/1/1 3/1/1\r\n"
+			"o entity1 (worldspawn)\r\n"
+			"g brush0\r\n"
+			"usemtl clip\r\n"
+			"f 1/1/1 2/1/1 3/1/1\r\n";
+		M2PFormat::ObjReader reader = readObj(text);
+
+		REQUIRE(reader.entities.size() == 2);
+		CHECK(reader.entities[0]->classname == "func_map2prop");
+		CHECK(reader.entities[1]->classname == "worldspawn");
+
+		REQUIRE(reader.entities[0]->brushes.size() == 2);
+		const auto& faces = reader.entities[0]->brushes[0]->faces;
+		REQUIRE(faces.size() == 3);
+		CHECK(faces[0].texture.name == "clip");
+		CHECK(faces[1].texture.name == "origin");
+		CHECK(faces[2].texture.name == "origin");
+		CHECK(faces[0].texture.width == 16);
+		REQUIRE(faces[0].vertices.size() == 3);
+		CHECK(faces[0].vertices[1] == M2PGeo::Vector3{ 64, 0, 0 });
+		CHECK(faces[0].vertices[1].uv == M2PGeo::Vector2{ 1, -.5 });
+		CHECK(faces[0].vertices[1].normal == M2PGeo::Vector3{ 0, 0, 1 });
+		CHECK(faces[0].normal == M2PGeo::Vector3{ 0, 0, 1 });
+		CHECK(faces[1].normal == M2PGeo::Vector3{ 0, 0, -1 });
+
+		CHECK(reader.entities[0]->brushes[1]->faces.empty());
+		CHECK(reader.entities[1]->brushes[0]->faces.size() == 1);
+	}
+
+	TEST_CASE("threaded obj reading matches a single thread")
+	{
+		// Large enough for several chunks and face tasks
+		std::string coordinates, faces = "o entity0 (func_map2prop)\n";
+		int vertexCount = 0;
+		for (int brush = 0; brush < 200; ++brush)
+		{
+			faces += std::format("g brush{}\nusemtl {}\n", brush, brush % 2 ? "clip" : "origin");
+			for (int face = 0; face < 40; ++face)
+			{
+				for (int i = 0; i < 3; ++i)
+				{
+					const float x = static_cast<float>(brush * 8 + i * (face + 1)) * .125f;
+					coordinates += std::format("v {} {} {}\nvt {} {} 0\nvn 0 0 1\n", x, x * i, -i * .5f, x / 64, -x / 64);
+				}
+				vertexCount += 3;
+				faces += std::format("f {0}/{0}/{0} {1}/{1}/{1} {2}/{2}/{2}\n", vertexCount - 2, vertexCount - 1, vertexCount);
+			}
+		}
+		const std::string text = coordinates + faces;
+		REQUIRE(text.size() > (1 << 20));
+
+		M2PFormat::ObjReader serial = readObj(text);
+		M2PFormat::ObjReader threaded = readObj(text, 4);
+
+		REQUIRE(threaded.entities.size() == 1);
+		const auto& expected = serial.entities[0]->brushes;
+		const auto& actual = threaded.entities[0]->brushes;
+		REQUIRE(actual.size() == expected.size());
+		for (size_t i = 0; i < expected.size(); ++i)
+		{
+			REQUIRE(actual[i]->faces.size() == expected[i]->faces.size());
+			for (size_t j = 0; j < expected[i]->faces.size(); ++j)
+			{
+				const auto& a = actual[i]->faces[j];
+				const auto& b = expected[i]->faces[j];
+				CHECK(a.texture.name == b.texture.name);
+				REQUIRE(a.vertices.size() == b.vertices.size());
+				for (size_t k = 0; k < a.vertices.size(); ++k)
+				{
+					CHECK(a.vertices[k] == b.vertices[k]);
+					CHECK(a.vertices[k].uv == b.vertices[k].uv);
+				}
+			}
+		}
+		CHECK(actual.back()->faces.back().vertices.back().x == static_cast<float>(199 * 8 + 2 * 40) * .125f);
+	}
+}
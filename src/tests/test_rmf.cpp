@@ -0,0 +1,126 @@
+#include "doctest.h"
+#include <string>
+#include <cstdint>
+#include <filesystem>
+#include "rmf_format.h"
+#include "config.h"
+
+
+TEST_SUITE("rmf")
+{
+	/** Writes a minimal RMF 2.2 with a world brush and a func_map2prop holding one brush */
+	static std::string writeRmf()
+	{
+		std::string data;
+		auto putInt = [&data](std::int32_t value) { data.append(reinterpret_cast<const char*>(&value), sizeof(value)); };
+		auto putFloat = [&data](float value) { data.append(reinterpret_cast<const char*>(&value), sizeof(value)); };
+		auto putLPString = [&data](const std::string& value)
+		{
+			data += static_cast<char>(value.size() + 1);
+			data += value;
+			data += '\0';
+		};
+		auto putObjectData = [&](std::int32_t childCount)
+		{
+			putInt(0);  // Visgroup
+			data.append(3, '\0');  // Color
+			putInt(childCount);
+		};
+		auto putSolid = [&](float size, const std::string& texture)
+		{
+			// Each face of a box as its normal and vertices, counter-clockwise from outside
+			const float s = size;
+			const float faces[6][4][3]{
+				{ {-s,-s, s}, { s,-s, s}, { s, s, s}, {-s, s, s} },
+				{ {-s,-s,-s}, {-s, s,-s}, { s, s,-s}, { s,-s,-s} },
+				{ { s,-s,-s}, { s, s,-s}, { s, s, s}, { s,-s, s} },
+				{ {-s,-s,-s}, {-s,-s, s}, {-s, s, s}, {-s, s,-s} },
+				{ {-s, s,-s}, {-s, s, s}, { s, s, s}, { s, s,-s} },
+				{ {-s,-s,-s}, { s,-s,-s}, { s,-s, s}, {-s,-s, s} },
+			};
+
+			putLPString("CMapSolid");
+			putObjectData(0);
+			putInt(6);
+			for (const auto& face : faces)
+			{
+				std::string name = texture;
+				name.resize(260, '\0');
+				data += name;
+				for (float value : { 1.f, 0.f, 0.f, 8.f, 0.f, 0.f, -1.f, -4.f, 30.f, 1.f, .5f })
+					putFloat(value);  // Right axis, shift, down axis, shift, angle, scale
+				data.append(16, '\0');
+
+				putInt(4);
+				for (int i = 3; i >= 0; --i)
+				{
+					for (float coord : face[i])
+						putFloat(coord);
+				}
+				for (int i = 2; i >= 0; --i)
+				{
+					for (float coord : face[i])
+						putFloat(coord);
+				}
+			}
+		};
+
+		putFloat(2.2f);
+		data += "RMF";
+		putInt(0);  // Visgroups
+		putLPString("CMapWorld");
+		putObjectData(2);
+
+		putSolid(64.f, "world_texture");
+
+		putLPString("CMapEntity");
+		putObjectData(1);
+		putSolid(16.f, "prop_texture");
+		putLPString("func_map2prop");
+		putInt(0);
+		putInt(0);  // Spawnflags
+		putInt(0);  // Keyvalues
+		data.append(14, '\0');
+		for (int i = 0; i < 3; ++i)
+			putFloat(0.f);  // Origin
+		data.append(4, '\0');
+
+		putLPString("worldspawn");
+		putInt(0);
+		putInt(0);
+		putInt(0);
+		data.append(12, '\0');
+		putInt(0);  // Paths
+
+		return data;
+	}
+
+	TEST_CASE("map compile keeps raw faces of entities that aren't converted")
+	{
+		const std::string data = writeRmf();
+		const std::filesystem::path filepath = "test.rmf";
+		const std::filesystem::path outputDir = std::filesystem::temp_directory_path();
+
+		M2PFormat::RmfReader full{ data, filepath, outputDir };
+
+		M2PConfig::g_config.mapcompile = true;
+		M2PFormat::RmfReader compile{ data, filepath, outputDir };
+		M2PConfig::g_config.mapcompile = false;
+
+		REQUIRE(full.entities.size() == 2);
+		REQUIRE(compile.entities.size() == 2);
+		REQUIRE(compile.entities[0]->classname == "worldspawn");
+		REQUIRE(compile.entities[1]->classname == "func_map2prop");
+
+		const M2PEntity::Brush& world = *compile.entities[0]->brushes[0];
+		CHECK(world.faces.empty());
+		CHECK(world.rawFaces.size() == 6);
+		CHECK(world.getRaw() == full.entities[0]->brushes[0]->getRaw());
+		CHECK(world.getRaw().find("world_texture [ 1 0 0 8 ] [ 0 0 -1 -4 ] 30 1 0.5\n") != std::string::npos);
+
+		const M2PEntity::Brush& prop = *compile.entities[1]->brushes[0];
+		CHECK(prop.rawFaces.empty());
+		CHECK(prop.faces.size() == 6);
+		CHECK(prop.getRaw() == full.entities[1]->brushes[0]->getRaw());
+	}
+}
@@ -0,0 +1,52 @@
+#include "doctest.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <filesystem>
+#include "wad3.h"
+
+using namespace M2PWad3;
+
+
+TEST_SUITE("wad3")
+{
+    TEST_CASE("directory lookups ignore case")
+    {
+        // Only the directory is read, so the entries can point anywhere
+        const char* names[]{ "Wood", "WOOD", "{FENCE", "SIXTEENCHARSNAME" };
+        std::vector<Wad3DirEntry> entries;
+        for (const char* name : names)
+        {
+            Wad3DirEntry entry{};
+            entry.nType = entries.empty() ? EntryType::QPIC : EntryType::MIPTEX;
+            std::memcpy(entry.szName, name, std::min(std::strlen(name), c_MAXTEXTURENAME));
+            entries.push_back(entry);
+        }
+
+        const std::filesystem::path filepath = std::filesystem::temp_directory_path() / "m2p_test.wad";
+        {
+            Wad3Header header{ { 'W', 'A', 'D', '3' }, static_cast<std::int32_t>(entries.size()), sizeof(Wad3Header) };
+            std::ofstream file{ filepath, std::ios::binary };
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(Wad3DirEntry));
+        }
+        Wad3Reader reader{ filepath };
+        std::filesystem::remove(filepath);
+
+        CHECK(reader.contains("wood"));
+        CHECK(reader.contains("{fence"));
+        CHECK(reader.contains("SixteenCharsName"));
+        CHECK_FALSE(reader.contains("fence"));
+        CHECK_FALSE(reader.contains("sixteencharsnames"));
+        CHECK_FALSE(reader.contains(""));
+
+        // The first of two entries with the same name is the one found
+        CHECK_THROWS_AS(reader.extract("wood", std::filesystem::temp_directory_path()), std::runtime_error);
+
+        // The WAD is gone, failing to open it is left for the caller to report
+        CHECK_THROWS_AS(reader.extract("{fence", std::filesystem::temp_directory_path()), std::runtime_error);
+        CHECK_THROWS_AS(Wad3Reader{ filepath }, std::runtime_error);
+    }
+}